@@ -0,0 +1,427 @@
+#include <math.h>
+
+#include "vivid.h"
+
+/*
+ * Microbenchmarks for the VIVID draw functions. Every benchmark is run as a
+ * number of samples, each sample calling the function enough times to take
+ * at least `BENCH_SAMPLE_MS`, and reports the mean time per call, the spread
+ * between samples and the pixel throughput. Uses the SDL dummy video driver
+ * unless `SDL_VIDEODRIVER` is already set, so it runs without a display.
+ *
+ * Usage: vivid_bench [filter]
+ *     Only run the benchmarks whose name contains `filter`.
+ */
+
+#define BENCH_WIDTH         800
+#define BENCH_HEIGHT        600
+#define BENCH_SAMPLES       15
+#define BENCH_SAMPLE_MS     5
+#define BENCH_CAPTURE       "vivid_bench.vcap"
+#define BENCH_BATCH         1024
+
+typedef struct _bench {
+    const char* name;
+    double      pixels; // Pixels touched per call
+    void        (*setup)(vivid_context*);
+    void        (*run)(vivid_context*, Uint32);
+} bench;
+
+static vivid_colour bench_sprite[64 * 64];
+static vivid_sprite bench_opaque;
+static vivid_sprite bench_blend;
+static vivid_font bench_font;
+
+/* Scattered positions and colours for the batched draws */
+static Sint16 bench_x[BENCH_BATCH];
+static Sint16 bench_y[BENCH_BATCH];
+static vivid_rect bench_rects[BENCH_BATCH];
+static vivid_colour bench_colours[BENCH_BATCH];
+
+static const vivid_colour bench_translucent = { .hex = 0x803131CD };
+
+/* Immediate mode, eager clears and colour unless the benchmark asks 
+ * otherwise */
+static void setup_immediate(vivid_context* c) {
+    vivid_set_deferred(c, 0);
+    vivid_set_lazy_clear(c, 0);
+    vivid_set_indexed(c, 0);
+    vivid_capture_stop(c);
+}
+
+static void setup_deferred(vivid_context* c) {
+    vivid_set_deferred(c, VIVID_THREADS_AUTO);
+    vivid_set_lazy_clear(c, 0);
+    vivid_set_indexed(c, 0);
+    vivid_capture_stop(c);
+}
+
+static void setup_lazy(vivid_context* c) {
+    vivid_set_deferred(c, 0);
+    vivid_set_lazy_clear(c, 1);
+    vivid_set_indexed(c, 0);
+    vivid_capture_stop(c);
+}
+
+static void setup_indexed(vivid_context* c) {
+    vivid_set_deferred(c, 0);
+    vivid_set_lazy_clear(c, 0);
+    vivid_set_indexed(c, 1);
+    vivid_capture_stop(c);
+}
+
+/* Records every frame, waiting for the writer whenever it falls behind */
+static void setup_capture(vivid_context* c) {
+    setup_immediate(c);
+    vivid_capture_start(c, BENCH_CAPTURE, 4, VIVID_CAPTURE_BLOCK);
+}
+
+/* Spread positions over the window so each call hits a different spot */
+static int pos_x(Uint32 i, int w) { 
+    return (int) ((i * 97) % (BENCH_WIDTH - w)); 
+}
+static int pos_y(Uint32 i, int h) { 
+    return (int) ((i * 61) % (BENCH_HEIGHT - h)); 
+}
+
+static void run_pixel(vivid_context* c, Uint32 i) {
+    vivid_draw_pixel(c, VIVID_POINT(pos_x(i, 1), pos_y(i, 1)), VIVID_RED);
+}
+
+static void run_pixel_blend(vivid_context* c, Uint32 i) {
+    vivid_draw_pixel(c, VIVID_POINT(pos_x(i, 1), pos_y(i, 1)), 
+        bench_translucent);
+}
+
+static void run_rect(vivid_context* c, Uint32 i) {
+    vivid_draw_rect(c, VIVID_RECT1(pos_x(i, 64), pos_y(i, 64), 64, 64), 
+        VIVID_GREEN);
+}
+
+static void run_rect_blend(vivid_context* c, Uint32 i) {
+    vivid_draw_rect(c, VIVID_RECT1(pos_x(i, 64), pos_y(i, 64), 64, 64), 
+        bench_translucent);
+}
+
+/* 64x64 rects with only the bottom right 32x32 quarter inside the window */
+static void run_rect_clipped(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_draw_rect(c, VIVID_RECT1(-32, -32, 64, 64), VIVID_GREEN);
+}
+
+static void run_rect_clipped_blend(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_draw_rect(c, VIVID_RECT1(-32, -32, 64, 64), bench_translucent);
+}
+
+static void run_rect_full(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_draw_rect(c, VIVID_RECT1(0, 0, BENCH_WIDTH, BENCH_HEIGHT), 
+        VIVID_GREEN);
+}
+
+static void run_rect_full_blend(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_draw_rect(c, VIVID_RECT1(0, 0, BENCH_WIDTH, BENCH_HEIGHT), 
+        bench_translucent);
+}
+
+/* Deferred fills are only finished once they are flushed */
+static void run_rect_full_blend_deferred(vivid_context* c, Uint32 i) {
+    vivid_draw_rect(c, VIVID_RECT1(0, 0, BENCH_WIDTH, BENCH_HEIGHT), 
+        bench_translucent);
+    if (i % 8 == 7)
+        vivid_flush(c);
+}
+
+static void run_line(vivid_context* c, Uint32 i) {
+    const int x = pos_x(i, 256), y = pos_y(i, 256);
+    vivid_draw_line(c, VIVID_POINT(x, y), VIVID_POINT(x + 255, y + 127), 
+        VIVID_BLUE);
+}
+
+/* 256 pixel long lines of which only the last 64 steps are visible */
+static void run_line_clipped(vivid_context* c, Uint32 i) {
+    const int y = pos_y(i, 64);
+    vivid_draw_line(c, VIVID_POINT(-192, y), VIVID_POINT(63, y + 63), 
+        VIVID_BLUE);
+}
+
+static void run_line_aa(vivid_context* c, Uint32 i) {
+    const int x = pos_x(i, 256), y = pos_y(i, 256);
+    vivid_draw_line_aa(c, VIVID_POINT(x, y), VIVID_POINT(x + 255, y + 127), 
+        VIVID_BLUE);
+}
+
+static void run_sprite(vivid_context* c, Uint32 i) {
+    vivid_draw_sprite(c, VIVID_RECT1(pos_x(i, 64), pos_y(i, 64), 64, 64), 
+        bench_sprite);
+}
+
+static void run_sprite_opaque(vivid_context* c, Uint32 i) {
+    vivid_draw_prepared_sprite(c, VIVID_POINT(pos_x(i, 64), pos_y(i, 64)), 
+        &bench_opaque);
+}
+
+static void run_sprite_blend(vivid_context* c, Uint32 i) {
+    vivid_draw_prepared_sprite(c, VIVID_POINT(pos_x(i, 64), pos_y(i, 64)), 
+        &bench_blend);
+}
+
+static void run_rect_small(vivid_context* c, Uint32 i) {
+    vivid_draw_rect(c, VIVID_RECT1(pos_x(i, 8), pos_y(i, 8), 8, 8), 
+        VIVID_GREEN);
+}
+
+static void run_points(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_draw_points(c, bench_x, bench_y, BENCH_BATCH, NULL, VIVID_RED);
+}
+
+static void run_points_blend(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_draw_points(c, bench_x, bench_y, BENCH_BATCH, bench_colours, 
+        VIVID_RED);
+}
+
+static void run_rects(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_draw_rects(c, bench_rects, BENCH_BATCH / 4, NULL, VIVID_GREEN);
+}
+
+static void run_sprites(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_draw_sprites(c, bench_x, bench_y, BENCH_BATCH / 16, 
+        &bench_blend);
+}
+
+/* 64x64 sprite drawn at twice its size */
+static void run_sprite_scaled(vivid_context* c, Uint32 i) {
+    vivid_draw_sprite_scaled(c, VIVID_RECT1(pos_x(i, 128), pos_y(i, 128), 
+        128, 128), bench_sprite, 64, 64, VIVID_FILTER_NEAREST);
+}
+
+/* 64x64 sprite rotated by a different angle every call */
+static void run_sprite_rotated(vivid_context* c, Uint32 i) {
+    vivid_draw_sprite_rotated(c, VIVID_RECT1(pos_x(i, 92) + 46, 
+        pos_y(i, 92) + 46, 64, 64), bench_sprite, i * 0.01, 1.0, 
+        VIVID_FILTER_NEAREST);
+}
+
+static void run_sprite_rotated_bilinear(vivid_context* c, Uint32 i) {
+    vivid_draw_sprite_rotated(c, VIVID_RECT1(pos_x(i, 92) + 46, 
+        pos_y(i, 92) + 46, 64, 64), bench_sprite, i * 0.01, 1.0, 
+        VIVID_FILTER_BILINEAR);
+}
+
+/* Right triangles with 8 or 64 pixel legs, the small ones as in a mesh */
+static void run_triangle_small(vivid_context* c, Uint32 i) {
+    const int x = pos_x(i, 8), y = pos_y(i, 8);
+    vivid_draw_triangle(c, VIVID_POINT(x, y), VIVID_POINT(x + 8, y), 
+        VIVID_POINT(x, y + 8), VIVID_GREEN);
+}
+
+static void run_triangle(vivid_context* c, Uint32 i) {
+    const int x = pos_x(i, 64), y = pos_y(i, 64);
+    vivid_draw_triangle(c, VIVID_POINT(x, y), VIVID_POINT(x + 64, y), 
+        VIVID_POINT(x, y + 64), VIVID_GREEN);
+}
+
+static void run_triangle_blend(vivid_context* c, Uint32 i) {
+    const int x = pos_x(i, 64), y = pos_y(i, 64);
+    vivid_draw_triangle(c, VIVID_POINT(x, y), VIVID_POINT(x + 64, y), 
+        VIVID_POINT(x, y + 64), bench_translucent);
+}
+
+static void run_circle(vivid_context* c, Uint32 i) {
+    vivid_draw_circle(c, VIVID_POINT(pos_x(i, 65) + 32, pos_y(i, 65) + 32), 
+        32, VIVID_YELLOW);
+}
+
+/* 16 character labels like the ones on a monitoring screen */
+static void run_text(vivid_context* c, Uint32 i) {
+    vivid_draw_text(c, VIVID_POINT(pos_x(i, 128), pos_y(i, 8)), 
+        "cpu0 load 42.5 %", &bench_font, VIVID_WHITE);
+}
+
+static void run_text_blend(vivid_context* c, Uint32 i) {
+    vivid_draw_text(c, VIVID_POINT(pos_x(i, 128), pos_y(i, 8)), 
+        "cpu0 load 42.5 %", &bench_font, bench_translucent);
+}
+
+static void run_clear(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_clear(c);
+}
+
+/* Upload and present with the whole buffer dirty */
+static void run_render_full(vivid_context* c, Uint32 i) {
+    (void) i;
+    vivid_invalidate(c);
+    vivid_render(c);
+}
+
+/* Upload and present with a single 64x64 region dirty */
+static void run_render_dirty(vivid_context* c, Uint32 i) {
+    run_rect(c, i);
+    vivid_render(c);
+}
+
+/* A whole frame that only draws a single 64x64 rect */
+static void run_frame_small(vivid_context* c, Uint32 i) {
+    vivid_clear(c);
+    run_rect(c, i);
+    vivid_render(c);
+}
+
+static const bench benches[] = {
+    { "pixel",                  1, setup_immediate, run_pixel },
+    { "pixel_blend",            1, setup_immediate, run_pixel_blend },
+    { "rect_64",             4096, setup_immediate, run_rect },
+    { "rect_64_blend",       4096, setup_immediate, run_rect_blend },
+    { "rect_64_clipped",     1024, setup_immediate, run_rect_clipped },
+    { "rect_64_clipped_blend", 
+                             1024, setup_immediate, run_rect_clipped_blend },
+    { "rect_full",         480000, setup_immediate, run_rect_full },
+    { "rect_full_blend",   480000, setup_immediate, run_rect_full_blend },
+    { "rect_64_indexed",     4096, setup_indexed,   run_rect },
+    { "rect_full_indexed", 480000, setup_indexed,   run_rect_full },
+    { "rect_full_blend_deferred", 
+                           480000, setup_deferred,  
+                                   run_rect_full_blend_deferred },
+    { "rect_8",                64, setup_immediate, run_rect_small },
+    { "points_1024",         1024, setup_immediate, run_points },
+    { "points_1024_blend",   1024, setup_immediate, run_points_blend },
+    { "points_1024_deferred",
+                             1024, setup_deferred,  run_points },
+    { "rects_256_8x8",      16384, setup_immediate, run_rects },
+    { "sprites_64_prepared_blend",
+                           262144, setup_immediate, run_sprites },
+    { "line_256",             256, setup_immediate, run_line },
+    { "line_256_clipped",      64, setup_immediate, run_line_clipped },
+    { "line_aa_256",          512, setup_immediate, run_line_aa },
+    { "sprite_64",           4096, setup_immediate, run_sprite },
+    { "sprite_64_prepared_opaque", 
+                             4096, setup_immediate, run_sprite_opaque },
+    { "sprite_64_prepared_blend", 
+                             4096, setup_immediate, run_sprite_blend },
+    { "sprite_64_scaled_2x",16384, setup_immediate, run_sprite_scaled },
+    { "sprite_64_rotated",   4096, setup_immediate, run_sprite_rotated },
+    { "sprite_64_rotated_bilinear", 
+                             4096, setup_immediate, 
+                                   run_sprite_rotated_bilinear },
+    { "triangle_8",            36, setup_immediate, run_triangle_small },
+    { "triangle_64",         2080, setup_immediate, run_triangle },
+    { "triangle_64_blend",   2080, setup_immediate, run_triangle_blend },
+    { "circle_32",           3209, setup_immediate, run_circle },
+    { "text_16",             1024, setup_immediate, run_text },
+    { "text_16_blend",       1024, setup_immediate, run_text_blend },
+    { "clear",             480000, setup_immediate, run_clear },
+    { "clear_lazy",        480000, setup_lazy,      run_clear },
+    { "clear_indexed",     480000, setup_indexed,   run_clear },
+    { "render_full",       480000, setup_immediate, run_render_full },
+    { "render_full_indexed", 
+                           480000, setup_indexed,   run_render_full },
+    { "render_dirty_64",     4096, setup_immediate, run_render_dirty },
+    { "render_full_capture", 480000, setup_capture,   run_render_full },
+    { "frame_rect_64_capture",
+                             4096, setup_capture,   run_frame_small },
+    { "frame_rect_64",       4096, setup_immediate, run_frame_small },
+    { "frame_rect_64_lazy",  4096, setup_lazy,      run_frame_small },
+};
+
+static double bench_seconds(Uint64 start, Uint64 end) {
+    return (double) (end - start) / (double) SDL_GetPerformanceFrequency();
+}
+
+/*
+ * Time `n` calls of the benchmark in seconds.
+ */
+static double bench_batch(vivid_context* c, const bench* b, Uint32 n) {
+    const Uint64 start = SDL_GetPerformanceCounter();
+    for (Uint32 i = 0; i < n; i++)
+        b->run(c, i);
+    vivid_flush(c);
+
+    return bench_seconds(start, SDL_GetPerformanceCounter());
+}
+
+static void bench_run(vivid_context* c, const bench* b) {
+    b->setup(c);
+
+    // Find a batch size that fills the sample time, this doubles as warm up
+    Uint32 n = 1;
+    while (bench_batch(c, b, n) < BENCH_SAMPLE_MS / 1000.0 && n < (1u << 30))
+        n *= 2;
+
+    double samples[BENCH_SAMPLES];
+    double mean = 0.0, best = 0.0;
+    for (int s = 0; s < BENCH_SAMPLES; s++) {
+        samples[s] = bench_batch(c, b, n) * 1e9 / n;
+        mean += samples[s];
+        if (s == 0 || samples[s] < best)
+            best = samples[s];
+    }
+    mean /= BENCH_SAMPLES;
+
+    double var = 0.0;
+    for (int s = 0; s < BENCH_SAMPLES; s++)
+        var += (samples[s] - mean) * (samples[s] - mean);
+    const double sd = sqrt(var / (BENCH_SAMPLES - 1));
+
+    printf("%-28s %12.1f %12.1f %7.1f%% %12.1f\n", b->name, mean, best, 
+        100.0 * sd / mean, b->pixels * 1e3 / mean);
+}
+
+int main(int argc, char* argv[]) {
+    const char* filter = argc > 1 ? argv[1] : NULL;
+
+    // Keep the benchmark runnable on machines without a display
+    SDL_setenv("SDL_VIDEODRIVER", "dummy", 0);
+
+    vivid_context _con = vivid_create("Vivid Bench", BENCH_WIDTH, 
+        BENCH_HEIGHT, 0);
+
+    // Sprite with an opaque middle, translucent ring and transparent corners
+    for (int y = 0; y < 64; y++) {
+        for (int x = 0; x < 64; x++) {
+            const int d = abs(x - 32) + abs(y - 32);
+            vivid_colour c = VIVID_MAGENTA;
+            c.a = d < 24 ? 255 : d < 40 ? 128 : 0;
+            bench_sprite[y * 64 + x] = c;
+        }
+    }
+    bench_blend = vivid_sprite_create(bench_sprite, 64, 64);
+
+    vivid_colour opaque[64 * 64];
+    for (int i = 0; i < 64 * 64; i++)
+        opaque[i] = VIVID_CYAN;
+    bench_opaque = vivid_sprite_create(opaque, 64, 64);
+    bench_font = vivid_font_create_default();
+
+    // Batches hit the whole window in no particular order
+    for (int i = 0; i < BENCH_BATCH; i++) {
+        bench_x[i] = (Sint16) pos_x(i * 7919, 64);
+        bench_y[i] = (Sint16) pos_y(i * 104729, 64);
+        bench_rects[i] = VIVID_RECT1(bench_x[i], bench_y[i], 8, 8);
+        bench_colours[i] = bench_translucent;
+        bench_colours[i].r = (Uint8) i;
+    }
+
+    printf("%-28s %12s %12s %8s %12s\n", "benchmark", "mean ns/call", 
+        "min ns/call", "stddev", "Mpixels/s");
+
+    for (size_t i = 0; i < sizeof(benches) / sizeof(benches[0]); i++) {
+        if (filter && !strstr(benches[i].name, filter))
+            continue;
+        bench_run(&_con, &benches[i]);
+    }
+
+    vivid_sprite_clean(&bench_opaque);
+    vivid_sprite_clean(&bench_blend);
+    vivid_font_clean(&bench_font);
+    vivid_clean(&_con);
+    remove(BENCH_CAPTURE);
+
+    return 0;
+}
@@ -1,5 +1,6 @@
 #include <stdio.h>
-#include <sys/timeb.h>
+#include <stdlib.h>
+#include <string.h>
 
 #if defined(_WIN32) || defined(WIN32) 
     #include <windows.h>
@@ -7,6 +8,13 @@
 
 #include "SDL2/SDL.h"
 
+/* Vectorised kernels, define VIVID_NO_SIMD to build with scalar code only */
+#if !defined(VIVID_NO_SIMD) && defined(__GNUC__) &&                           \
+    (defined(__x86_64__) || defined(__i386__))
+    #define VIVID_X86
+    #include <immintrin.h>
+#endif
+
 #define VIVID_OK        0
 #define VIVID_FAIL      1
 
@@ -20,19 +28,21 @@
 
 /* Used to time performance of a chunk of code */
 #define VIVID_TIMER(proc, code) {                                             \
-    struct timeb s, e;                                                        \
-    Uint64 diff;                                                              \
-    ftime(&s);                                                                \
+    Uint64 s, e;                                                              \
+    s = SDL_GetPerformanceCounter();                                          \
     {code}                                                                    \
-    ftime(&e);                                                                \
-    diff = (int) (1000.0 * (e.time - s.time) + (e.millitm - s.millitm));      \
-    printf("VIVID TIMER (%s) [%lums]\n", proc, diff);                         \
+    e = SDL_GetPerformanceCounter();                                          \
+    printf("VIVID TIMER (%s) [%.3fms]\n", proc,                               \
+        1000.0 * (double) (e - s) / (double) SDL_GetPerformanceFrequency());  \
 }
 
+/* Headless contexts only own the window buffer, there is no SDL to check */
 #define VIVID_ASSERT_CONTEXT(context) {                                       \
-    if (!((context)->_window) ||                                              \
+    if (!((context)->window_buffer) ||                                        \
+        (!((context)->_headless) &&                                           \
+        (!((context)->_window) ||                                             \
         !((context)->_renderer) ||                                            \
-        !((context)->_texture)) {                                             \
+        !((context)->_texture)))) {                                           \
             printf("VIVID Context not Initialise");                           \
             return VIVID_FAIL;                                                \
     }                                                                         \
@@ -47,8 +57,9 @@ typedef struct _vivid_colour {
 } vivid_colour; // ABGR8888 Format
 
 typedef struct _vivid_rect {
-    Uint16 x, y, w, h;
-} vivid_rect; // Rect ([x, y], [x + w, y + h])
+    Sint16 x, y;
+    Uint16 w, h;
+} vivid_rect; // Rect ([x, y], [x + w, y + h]), x and y may be off-screen
 
 #define VIVID_POINT(x0,y0)                                                    \
     ((vivid_rect) { .x = (x0), .y = (y0), .w = 0, .h = 0 })
@@ -57,6 +68,175 @@ typedef struct _vivid_rect {
 #define VIVID_RECT1(x0,y0,w0,h0)                                              \
     ((vivid_rect) { .x = (x0), .y = (y0), .w = (w0), .h = (h0) })
 
+/* Colour drawing palette entry `i` on indexed contexts, see 
+ * `vivid_set_indexed` */
+#define VIVID_INDEX(i)                                                        \
+    ((vivid_colour) { .hex = 0xFF000000 | (Uint8) (i) })
+
+typedef struct _vivid_box {
+    int x0, y0, x1, y1;
+} _vivid_box; // Clipped region ([x0, y0], [x1, y1]) exclusive of x1 and y1
+
+/* Most regions tracked as changed between frames before they are merged */
+#define VIVID_DIRTY_MAX     16
+
+/* Deferred rendering, the screen is rasterised in square tiles of this size */
+#define VIVID_TILE_SIZE     64
+#define VIVID_THREADS_AUTO  0xFF
+
+typedef struct _vivid_deferred _vivid_deferred;
+typedef struct _vivid_batch_item _vivid_batch_item;
+
+typedef struct _vivid_clear_tile {
+    Uint32 valid;   // Clear generation the tile's pixels are up to date with
+    Uint32 drawn;   // Clear generation the tile was last drawn to in
+} _vivid_clear_tile;
+
+/* Number of frames the profiler keeps, see `vivid_profile_enable` */
+#define VIVID_PROFILE_FRAMES    256
+
+typedef struct _vivid_frame_stats {
+    Uint64  frame_ns;   // Between the end of the previous and this render
+    Uint64  draw_ns;    // In draw functions and rasterising deferred commands
+    Uint64  clear_ns;   // In `vivid_clear`
+    Uint64  upload_ns;  // Copying the buffer to the texture
+    Uint64  present_ns; // Copying the texture to the window and presenting
+    Uint64  capture_ns; // Copying the changed tiles for the capture writer
+    Uint64  primitives;
+    Uint64  pixels;     // Pixels inside the clipped bounds of each primitive
+} vivid_frame_stats;
+
+typedef struct _vivid_profile_summary {
+    Uint32              frames;
+    vivid_frame_stats   min, avg, p99;
+} vivid_profile_summary;
+
+typedef struct _vivid_profiler {
+    vivid_frame_stats   frames[VIVID_PROFILE_FRAMES];
+    vivid_frame_stats   current;
+    Uint32              head;       // Next slot of `frames` to write
+    Uint32              count;
+    Uint64              last_render;
+    Uint8               paused;     // Set while drawing the overlay
+} _vivid_profiler;
+
+/* Pipelined presentation, a context can have at most this many frames */
+#define VIVID_QUEUE_MAX     4
+
+typedef struct _vivid_config {
+    Uint32  renderer_flags; // SDL_RENDERER_* flags, 0 lets SDL choose
+    Uint8   vsync;          // Wait for the display refresh when presenting
+    Uint8   queue_depth;    // Frame buffers, above 1 presents on a thread of 
+                            // its own, see `vivid_create_ex`
+    Uint16  target_fps;     // Frame pacing, 0 presents as soon as possible
+} vivid_config;
+
+#define VIVID_CONFIG_DEFAULT                                                  \
+    ((vivid_config) { SDL_RENDERER_SOFTWARE, 0, 1, 0 })
+
+typedef struct _vivid_frame_slot {
+    vivid_colour*   buffer;
+
+    /* Regions changed by the frame last submitted from this buffer */
+    _vivid_box      dirty[VIVID_DIRTY_MAX];
+    Uint8           dirty_count;
+    Uint8           dirty_full;
+
+    /* Written by the present thread once the frame is on screen */
+    Uint64          upload_ns;
+    Uint64          present_ns;
+} _vivid_frame_slot;
+
+typedef struct _vivid_present {
+    int                 w, h;
+    vivid_config        config;
+
+    /* Owned by the present thread, it creates and destroys them */
+    SDL_Renderer*       renderer;
+    SDL_Texture*        texture;
+
+    /* Frame `n` is drawn into slots[n % depth] */
+    _vivid_frame_slot   slots[VIVID_QUEUE_MAX];
+    int                 depth;
+    Uint32              submitted;  // Only touched by the drawing thread
+    Uint32              presented;  // Only touched by the present thread
+    Uint64              pace_next;
+
+    /* Context being created, only valid until `started` is posted, along 
+     * with the reason the renderer couldn't be created if it failed */
+    struct _vivid_context* init;
+    SDL_sem*            started;
+    char                error[256];
+
+    SDL_sem*            ready;      // Frames waiting to be presented
+    SDL_sem*            free;       // Buffers that can be drawn into again
+    SDL_atomic_t        quit;
+    SDL_Thread*         thread;
+} _vivid_present;
+
+/* Frame capture, what `vivid_render` does when every buffer is queued */
+#define VIVID_CAPTURE_DROP      0   // Skip it, its tiles go in the next one
+#define VIVID_CAPTURE_BLOCK     1   // Wait for the writer to free a buffer
+#define VIVID_CAPTURE_MAX       8
+
+#define VIVID_CAPTURE_MAGIC     "VIVIDCAP"
+#define VIVID_CAPTURE_VERSION   1
+
+typedef struct _vivid_capture_stats {
+    Uint32  frames;     // Rendered since the capture started
+    Uint32  queued;     // Handed to the writer
+    Uint32  dropped;    // Skipped while every buffer was queued
+    Uint32  written;    // Stored in the file
+} vivid_capture_stats;
+
+typedef struct _vivid_capture_slot {
+    Uint32*         tiles;      // Indices of the tiles copied into `pixels`
+    Uint32          tile_count;
+    Uint32*         pixels;     // Rows of each tile in turn
+    Uint32          frame;
+    Uint64          time_ns;
+} _vivid_capture_slot;
+
+typedef struct _vivid_capture {
+    FILE*               file;
+    int                 w, h;
+    int                 tiles_x, tiles_y;
+    Uint8               policy;
+    Uint64              start;
+
+    /* Tiles changed since the last queued frame, only touched by the 
+     * drawing thread like the counters */
+    Uint8*              pending;
+    Uint32              frames, queued, dropped;
+
+    /* Frame `n` handed to the writer is copied into slots[n % depth] */
+    _vivid_capture_slot slots[VIVID_CAPTURE_MAX];
+    int                 depth;
+
+    /* Owned by the writer thread, the frame as the decoder will see it */
+    Uint32*             last;
+    Uint32              stored;
+    SDL_atomic_t        written;
+    SDL_atomic_t        failed;
+
+    SDL_sem*            ready;      // Frames waiting to be written
+    SDL_sem*            free;       // Buffers that can be filled again
+    SDL_atomic_t        quit;
+    SDL_Thread*         thread;
+} _vivid_capture;
+
+/* Batched draws are sorted into bins, one per band of tile rows when drawing 
+ * immediately, or a single one for sprites, and one per tile in deferred 
+ * mode */
+typedef struct _vivid_batch {
+    _vivid_batch_item*  items;      // Scratch space when drawing immediately
+    Uint32              capacity;
+    Uint32*             start;      // Items per bin, then each bin's first
+    _vivid_box*         bounds;     // Pixels covered by each bin's items
+    int                 cols;       // Bins per band
+    int                 rows;       // Bands, 1 when kept whole
+} _vivid_batch;
+
 typedef struct _vivid_context{
     const char*     window_title;
     vivid_rect      window_size;
@@ -65,12 +245,195 @@ typedef struct _vivid_context{
 
     vivid_colour*   window_buffer;
 
+    /* Set for contexts without a window, see `vivid_create_headless` */
+    Uint8           _headless;
+
     /* SDL components */
     SDL_Window*     _window;
     SDL_Renderer*   _renderer;
     SDL_Texture*    _texture;
+    vivid_config    _config;
+    Uint64          _pace_next;
+
+    /* Regions of the window buffer changed since the last upload */
+    _vivid_box      _dirty[VIVID_DIRTY_MAX];
+    Uint8           _dirty_count;
+    Uint8           _dirty_last;
+    Uint8           _dirty_full;
+
+    /* Per tile clear tracking, see `vivid_clear` and `vivid_set_lazy_clear` */
+    _vivid_clear_tile* _tiles;
+    int             _tiles_x, _tiles_y;
+    Uint32          _clear_gen;
+    vivid_colour    _clear_value;
+    Uint8           _lazy_clear;
+
+    /* Palette indices drawn instead of colours and the 256 entry palette 
+     * they are expanded with on upload, NULL unless indexed */
+    Uint8*          _indices;
+    Uint32*         _palette;
+
+    /* Bins of the batch being drawn, see `vivid_draw_points` */
+    _vivid_batch    _batch;
+
+    /* Recorded command list and worker pool, NULL when drawing immediately */
+    _vivid_deferred* _deferred;
+
+    /* Frame statistics, NULL unless profiling is enabled */
+    _vivid_profiler* _profiler;
+
+    /* Present thread and frame buffers, NULL when presenting in 
+     * `vivid_render` */
+    _vivid_present* _present;
+
+    /* Background frame recording, NULL unless capturing */
+    _vivid_capture* _capture;
 } vivid_context;
 
+/* Sprite preparation tuning, gaps shorter than this are blended over and
+ * opaque stretches at least this long are copied */
+#define VIVID_SPRITE_GAP    8
+#define VIVID_SPRITE_COPY   32
+
+/* Filtering for scaled and rotated sprites, sampled rows are blended in 
+ * chunks of this many pixels */
+#define VIVID_FILTER_NEAREST    0
+#define VIVID_FILTER_BILINEAR   1
+#define VIVID_AFFINE_CHUNK      256
+
+/* Triangles are rasterised in square blocks of this many pixels, blocks 
+ * entirely inside or outside the triangle skip the per pixel edge tests */
+#define VIVID_TRIANGLE_BLOCK    8
+
+typedef struct _vivid_sprite_run {
+    Uint16 x, w;
+    Uint8  opaque;
+} _vivid_sprite_run; // Visible pixels [x, x + w) of one sprite row
+
+typedef struct _vivid_sprite {
+    Uint16              w, h;
+
+    /* Premultiplied copy of the source pixels */
+    vivid_colour*       pixels;
+
+    /* Runs of visible pixels, row `y` owns runs[row_runs[y]..row_runs[y+1]] */
+    _vivid_sprite_run*  runs;
+    Uint32*             row_runs;
+} vivid_sprite;
+
+typedef struct _vivid_glyph {
+    Uint8   x, y, w, h; // Ink box inside the glyph cell, empty when w is 0
+    Uint32  offset;     // First coverage byte of the ink box in the atlas
+} _vivid_glyph;
+
+typedef struct _vivid_font {
+    Uint8           w, h;   // Glyph cell, every character advances by w
+    Uint8           first;  // Character code of glyph 0
+    Uint16          count;
+
+    /* Cached metrics and the ink boxes of every glyph, packed row by row as
+     * 8-bit coverage */
+    _vivid_glyph*   glyphs;
+    Uint8*          coverage;
+} vivid_font;
+
+#define VIVID_COMMAND_PIXEL     0
+#define VIVID_COMMAND_RECT      1
+#define VIVID_COMMAND_LINE      2
+#define VIVID_COMMAND_SPRITE    3
+#define VIVID_COMMAND_PREPARED  4
+#define VIVID_COMMAND_LINE_AA   5
+#define VIVID_COMMAND_AFFINE    6
+#define VIVID_COMMAND_TRIANGLE  7
+#define VIVID_COMMAND_ELLIPSE   8
+#define VIVID_COMMAND_TEXT      9
+#define VIVID_COMMAND_POINTS    10
+#define VIVID_COMMAND_RECTS     11
+#define VIVID_COMMAND_SPRITES   12
+
+/* One batched point, clipped rect or sprite position, added to every bin it 
+ * overlaps and clipped to the bin when drawn */
+struct _vivid_batch_item {
+    vivid_rect      p;
+    vivid_colour    colour;
+};
+
+typedef struct _vivid_command {
+    Uint8           type;
+    vivid_colour    colour;
+
+    /* Every pixel the command can touch, already clipped to the window */
+    _vivid_box      bounds;
+
+    union {
+        struct { int x0, y0, x1, y1, first, trim; } line; // Skip at ends
+        struct { int x, y, w, h; const vivid_colour* pixels; } sprite;
+        struct { int x, y; const vivid_sprite* sprite; } prepared;
+        struct {
+            const vivid_colour* pixels;
+            int     w, h;
+            Sint64  u0, v0;     // 16.16 source position of pixel (0, 0)
+            Sint32  dudx, dvdx; // 16.16 source step per pixel right
+            Sint32  dudy, dvdy; // 16.16 source step per pixel down
+            Uint8   filter;
+        } affine;
+        struct { int x0, y0, x1, y1, x2, y2; } triangle; // Clockwise
+        struct { int x, y, rx, ry; } ellipse;
+        struct {
+            int                 x, y;
+            Uint32              length;
+            const char*         text;
+            const vivid_font*   font;
+        } text;
+        struct {
+            const _vivid_batch_item*    items;  // All overlapping `bounds`
+            Uint32                      count;
+            const vivid_sprite*         sprite;
+        } batch;
+    };
+} _vivid_command;
+
+typedef struct _vivid_worker {
+    SDL_atomic_t        next;   // Next tile to claim from this worker's range
+    int                 end;    // One past the last tile of the range
+    SDL_sem*            start;
+    SDL_Thread*         thread;
+    _vivid_deferred*    deferred;
+} _vivid_worker;
+
+typedef struct _vivid_arena {
+    struct _vivid_arena* next;
+    size_t              size, used;
+    char                data[];
+} _vivid_arena; // Bump allocated block, blocks never move once allocated
+
+struct _vivid_deferred {
+    vivid_context*      context;
+
+    /* Commands recorded this frame, in submission order */
+    _vivid_command*     commands;
+    Uint32              command_count;
+    Uint32              command_capacity;
+
+    /* Copies of the strings and batches drawn this frame, so callers can 
+     * reuse theirs */
+    _vivid_arena*       arena;
+
+    /* Command indices binned per tile, tile `t` owns 
+     * tile_commands[tile_start[t]..tile_start[t+1]] */
+    int                 tiles_x, tiles_y;
+    Uint32*             tile_start;
+    Uint32*             tile_cursor;
+    Uint32*             tile_commands;
+    Uint32              tile_capacity;
+
+    /* Worker 0 is the thread calling `vivid_flush` */
+    int                 threads;
+    _vivid_worker*      workers;
+    SDL_sem*            done;
+    SDL_atomic_t        quit;
+};
+
 /* 8-Bit Colour Pallet from https://en.wikipedia.org/wiki/ANSI_escape_code*/
 #define VIVID_BLACK            ((vivid_colour) { .hex = 0xFF000000 })
 #define VIVID_RED              ((vivid_colour) { .hex = 0xFF3131CD })
@@ -91,7 +454,16 @@ typedef struct _vivid_context{
 
 /* Creation/Initialisation and cleaning of the VIVID system*/
 vivid_context vivid_create(const char*, Uint16, Uint16, Uint32);
+vivid_context vivid_create_ex(const char*, Uint16, Uint16, Uint32, 
+    vivid_config);
+vivid_context vivid_create_headless(Uint16, Uint16);
 Uint8 vivid_clean(vivid_context*);
+vivid_context _vivid_context_create(const char*, Uint16, Uint16, Uint32);
+
+/* Reading back and saving the window buffer */
+vivid_colour* vivid_get_buffer(vivid_context*);
+Uint8 vivid_write_raw(vivid_context*, const char*);
+Uint8 vivid_write_ppm(vivid_context*, const char*);
 
 /* SDL initialisers  */
 Uint8 _vivid_intialise(vivid_context*);
@@ -103,6 +475,25 @@ Uint8 _vivid_texture_create(vivid_context*);
 Uint8 vivid_clear(vivid_context*);
 Uint8 vivid_render(vivid_context*);
 Uint8 vivid_set_clear_colour(vivid_context*, vivid_colour);
+Uint8 vivid_set_lazy_clear(vivid_context*, Uint8);
+void _vivid_tiles_touch(vivid_context*, _vivid_box);
+void _vivid_tiles_ready(vivid_context*, _vivid_box);
+
+/* Dirty region tracking for the texture upload */
+Uint8 vivid_mark_dirty(vivid_context*, vivid_rect);
+Uint8 vivid_invalidate(vivid_context*);
+void _vivid_dirty_add(vivid_context*, _vivid_box);
+void _vivid_upload(SDL_Texture*, const vivid_colour*, const Uint8*, 
+    const Uint32*, int, int, const _vivid_box*, int, Uint8);
+void _vivid_upload_box(SDL_Texture*, const vivid_colour*, const Uint8*, 
+    const Uint32*, int, _vivid_box);
+
+/* Indexed colour */
+Uint8 vivid_set_indexed(vivid_context*, Uint8);
+Uint8 vivid_set_palette(vivid_context*, Uint8, const vivid_colour*, Uint16);
+Uint8* vivid_get_index_buffer(vivid_context*);
+void _vivid_expand(vivid_context*, _vivid_box);
+void _vivid_index_mask_row(Uint8*, const Uint8*, int, Uint8);
 
 /* Base draw functions */
 Uint8 vivid_draw_pixel(vivid_context*, vivid_rect, vivid_colour);
@@ -110,6 +501,162 @@ Uint8 vivid_draw_rect(vivid_context*, vivid_rect, vivid_colour);
 Uint8 vivid_draw_line(vivid_context*, vivid_rect, vivid_rect, vivid_colour);
 Uint8 vivid_draw_sprite(vivid_context*, vivid_rect, vivid_colour*);
 
+/* Batches of points, rects and prepared sprites */
+Uint8 vivid_draw_points(vivid_context*, const Sint16*, const Sint16*, Uint32, 
+    const vivid_colour*, vivid_colour);
+Uint8 vivid_draw_rects(vivid_context*, const vivid_rect*, Uint32, 
+    const vivid_colour*, vivid_colour);
+Uint8 vivid_draw_sprites(vivid_context*, const Sint16*, const Sint16*, 
+    Uint32, const vivid_sprite*);
+Uint8 _vivid_batch_boxes(vivid_context*, Uint8, const vivid_rect*, 
+    const Sint16*, const Sint16*, Uint32, const vivid_colour*, vivid_colour,
+    const vivid_sprite*);
+Uint32* _vivid_batch_begin(vivid_context*, Uint8);
+Uint32 _vivid_batch_count(vivid_context*, _vivid_box);
+_vivid_batch_item* _vivid_batch_alloc(vivid_context*, Uint32);
+void _vivid_batch_place(vivid_context*, _vivid_batch_item*, _vivid_box, 
+    _vivid_batch_item);
+Uint8 _vivid_batch_submit(vivid_context*, Uint8, const _vivid_batch_item*, 
+    const vivid_sprite*);
+void _vivid_raster_batch(vivid_context*, const _vivid_command*, _vivid_box);
+
+/* Lines */
+Uint8 vivid_draw_lines(vivid_context*, const vivid_rect*, Uint32, 
+    vivid_colour);
+Uint8 vivid_draw_line_aa(vivid_context*, vivid_rect, vivid_rect, 
+    vivid_colour);
+_vivid_box _vivid_line_bounds(const vivid_context*, int, int, int, int, int);
+Uint8 _vivid_line_steps(int, int, int, int, int, int, _vivid_box, int*, 
+    int*);
+void _vivid_raster_line(vivid_context*, const _vivid_command*, _vivid_box);
+void _vivid_raster_line_aa(vivid_context*, const _vivid_command*, 
+    _vivid_box);
+Sint64 _vivid_div_ceil(Sint64, Sint64);
+
+/* Scaled and rotated sprites */
+Uint8 vivid_draw_sprite_scaled(vivid_context*, vivid_rect, 
+    const vivid_colour*, Uint16, Uint16, Uint8);
+Uint8 vivid_draw_sprite_rotated(vivid_context*, vivid_rect, 
+    const vivid_colour*, double, double, Uint8);
+void _vivid_raster_affine(vivid_context*, const _vivid_command*, _vivid_box);
+Uint8 _vivid_affine_span(Sint64, Sint64, Sint64, int*, int*);
+Uint32 _vivid_sample_bilinear(const vivid_colour*, int, int, Sint64, Sint64);
+Uint32 _vivid_premultiply(Uint32);
+Uint32 _vivid_lerp(Uint32, Uint32, Uint32);
+
+/* Filled shapes */
+Uint8 vivid_draw_triangle(vivid_context*, vivid_rect, vivid_rect, vivid_rect,
+    vivid_colour);
+Uint8 vivid_draw_polygon(vivid_context*, const vivid_rect*, Uint32, 
+    vivid_colour);
+Uint8 vivid_draw_circle(vivid_context*, vivid_rect, Uint16, vivid_colour);
+Uint8 vivid_draw_ellipse(vivid_context*, vivid_rect, vivid_colour);
+Uint8 _vivid_submit_triangle(vivid_context*, int, int, int, int, int, int, 
+    vivid_colour);
+void _vivid_raster_triangle(vivid_context*, const _vivid_command*, 
+    _vivid_box);
+void _vivid_raster_ellipse(vivid_context*, const _vivid_command*, _vivid_box);
+Uint64 _vivid_isqrt(Uint64);
+
+/* Deferred, multithreaded rendering */
+Uint8 vivid_set_deferred(vivid_context*, Uint8);
+Uint8 vivid_flush(vivid_context*);
+Uint8 _vivid_submit(vivid_context*, const _vivid_command*);
+void _vivid_command_run(vivid_context*, const _vivid_command*, _vivid_box);
+void _vivid_deferred_destroy(vivid_context*);
+void _vivid_deferred_bin(_vivid_deferred*);
+void _vivid_tile_run(_vivid_deferred*, int);
+void _vivid_worker_run(_vivid_worker*);
+int _vivid_worker_main(void*);
+char* _vivid_arena_alloc(_vivid_arena**, size_t);
+char* _vivid_arena_copy(_vivid_arena**, const char*, size_t);
+void _vivid_arena_reset(_vivid_arena**);
+void _vivid_arena_free(_vivid_arena**);
+
+/* Pipelined presentation on a dedicated thread */
+Uint8 _vivid_present_start(vivid_context*);
+void _vivid_present_submit(vivid_context*);
+void _vivid_present_destroy(vivid_context*);
+int _vivid_present_main(void*);
+void _vivid_pace(Uint64*, Uint16);
+
+/* Frame capture on a background writer thread */
+Uint8 vivid_capture_start(vivid_context*, const char*, Uint8, Uint8);
+Uint8 vivid_capture_stop(vivid_context*);
+Uint8 vivid_capture_query(vivid_context*, vivid_capture_stats*);
+void _vivid_capture_frame(vivid_context*);
+Uint8 _vivid_capture_write(_vivid_capture*, _vivid_capture_slot*);
+int _vivid_capture_main(void*);
+_vivid_box _vivid_capture_tile(const _vivid_capture*, Uint32);
+
+/* Per frame profiling */
+Uint8 vivid_profile_enable(vivid_context*, Uint8);
+Uint8 vivid_profile_query(vivid_context*, Uint16, vivid_profile_summary*);
+Uint8 vivid_profile_overlay(vivid_context*, vivid_rect);
+Uint64 _vivid_profile_ns(Uint64);
+Uint64 _vivid_profile_p99(Uint64*, Uint32);
+
+/* Prepared sprites for repeated blitting */
+vivid_sprite vivid_sprite_create(vivid_colour*, Uint16, Uint16);
+vivid_sprite vivid_sprite_create_keyed(vivid_colour*, Uint16, Uint16, 
+    vivid_colour);
+Uint8 vivid_sprite_clean(vivid_sprite*);
+Uint8 vivid_draw_prepared_sprite(vivid_context*, vivid_rect, 
+    const vivid_sprite*);
+vivid_sprite _vivid_sprite_prepare(vivid_colour*, Uint16, Uint16, Uint8, 
+    vivid_colour);
+void _vivid_raster_prepared(vivid_context*, const vivid_sprite*, int, int, 
+    _vivid_box);
+
+/* Bitmap fonts and text */
+vivid_font vivid_font_create(const Uint8*, Uint8, Uint8, Uint8, Uint16);
+vivid_font vivid_font_create_bitmap(const Uint8*, Uint8, Uint8, Uint8, 
+    Uint16);
+vivid_font vivid_font_create_default(void);
+Uint8 vivid_font_clean(vivid_font*);
+Uint32 vivid_text_width(const vivid_font*, const char*);
+Uint8 vivid_draw_text(vivid_context*, vivid_rect, const char*, 
+    const vivid_font*, vivid_colour);
+void _vivid_raster_text(vivid_context*, const _vivid_command*, _vivid_box);
+void _vivid_blend_mask_row(vivid_colour*, const Uint8*, int, vivid_colour);
+
+/* Internal span helpers shared by the draw functions */
+_vivid_box _vivid_clip_rect(const vivid_context*, vivid_rect);
+_vivid_box _vivid_box_clip(_vivid_box, _vivid_box);
+void _vivid_span(vivid_context*, int, int, int, vivid_colour);
+void _vivid_fill_row(vivid_colour*, int, vivid_colour);
+void _vivid_clear_buffer(vivid_colour*, size_t, vivid_colour);
+void _vivid_blend_fill_row(vivid_colour*, int, vivid_colour);
+void _vivid_blend_row(vivid_colour*, const vivid_colour*, int);
+void _vivid_blend_row_pm(vivid_colour*, const vivid_colour*, int);
+Uint32 _vivid_blend_pixel(Uint32, Uint32);
+Uint32 _vivid_blend_pixel_pm(Uint32, Uint32);
+
+/* Alpha blend kernels, selected at runtime by `_vivid_select_kernels` */
+typedef void (*_vivid_blend_fill_fn)(vivid_colour*, int, vivid_colour);
+typedef void (*_vivid_blend_row_fn)(vivid_colour*, const vivid_colour*, int);
+typedef void (*_vivid_expand_fn)(Uint32*, const Uint8*, int, const Uint32*);
+
+void _vivid_select_kernels(void);
+void _vivid_blend_fill_row_scalar(vivid_colour*, int, vivid_colour);
+void _vivid_blend_row_scalar(vivid_colour*, const vivid_colour*, int);
+void _vivid_blend_row_pm_scalar(vivid_colour*, const vivid_colour*, int);
+void _vivid_expand_row_scalar(Uint32*, const Uint8*, int, const Uint32*);
+#if defined(VIVID_X86)
+void _vivid_blend_fill_row_sse2(vivid_colour*, int, vivid_colour);
+void _vivid_blend_row_sse2(vivid_colour*, const vivid_colour*, int);
+void _vivid_blend_row_pm_sse2(vivid_colour*, const vivid_colour*, int);
+void _vivid_blend_fill_row_avx2(vivid_colour*, int, vivid_colour);
+void _vivid_blend_row_avx2(vivid_colour*, const vivid_colour*, int);
+void _vivid_blend_row_pm_avx2(vivid_colour*, const vivid_colour*, int);
+void _vivid_expand_row_avx2(Uint32*, const Uint8*, int, const Uint32*);
+#endif
+
+_vivid_blend_fill_fn _vivid_blend_fill_impl = _vivid_blend_fill_row_scalar;
+_vivid_blend_row_fn  _vivid_blend_row_impl  = _vivid_blend_row_scalar;
+_vivid_blend_row_fn  _vivid_blend_row_pm_impl = _vivid_blend_row_pm_scalar;
+_vivid_expand_fn     _vivid_expand_impl = _vivid_expand_row_scalar;
+
 /*
  * Create the base context structure that stores the required data to abstract
  * the initialisation and handling of SDL.
@@ -117,6 +664,61 @@ Uint8 vivid_draw_sprite(vivid_context*, vivid_rect, vivid_colour*);
 vivid_context vivid_create(const char* title, Uint16 width, Uint16 height, 
         Uint32 flags) {
     
+    return vivid_create_ex(title, width, height, flags, VIVID_CONFIG_DEFAULT);
+}
+
+/*
+ * Create a context with the renderer, vsync, frame pacing and presentation
+ * queue described by `config`. With a `queue_depth` above 1 the context 
+ * owns that many frame buffers and a present thread, `vivid_render` hands
+ * the finished frame over and returns as soon as a buffer is free, so the 
+ * next frame is drawn while the last one is uploaded and presented. The 
+ * renderer is then created on the present thread while the window belongs 
+ * to the calling thread, which not every SDL backend supports: macOS and 
+ * OpenGL renderers bound to the window's thread need a `queue_depth` of 1.
+ * Creating the renderer failing panics on the calling thread.
+ */
+vivid_context vivid_create_ex(const char* title, Uint16 width, Uint16 height, 
+        Uint32 flags, vivid_config config) {
+
+    vivid_context _context = _vivid_context_create(title, width, height, 
+        flags);
+
+    if (config.queue_depth < 1)
+        config.queue_depth = 1;
+    if (config.queue_depth > VIVID_QUEUE_MAX)
+        config.queue_depth = VIVID_QUEUE_MAX;
+    _context._config = config;
+
+    // Initialise the SDL components
+    _vivid_intialise(&_context);
+
+    return _context;
+}
+
+/*
+ * Create a context that only owns the window buffer, without initialising 
+ * SDL or opening a window. Every draw function works as normal, 
+ * `vivid_render` only finishes the frame (nothing is presented) and the 
+ * result can be read with `vivid_get_buffer` or saved with `vivid_write_ppm`.
+ */
+vivid_context vivid_create_headless(Uint16 width, Uint16 height) {
+    vivid_context _context = _vivid_context_create("", width, height, 0);
+    _context._headless = 1;
+
+    // Pick the fastest blend kernels this CPU supports
+    _vivid_select_kernels();
+
+    return _context;
+}
+
+/*
+ * Fill in the parts of the context shared by windowed and headless contexts
+ * and allocate the window buffer.
+ */
+vivid_context _vivid_context_create(const char* title, Uint16 width, 
+        Uint16 height, Uint32 flags) {
+
     // Create the main context data structure based on parameters
     vivid_context _context = (vivid_context) { .window_title = title };
     _context.window_size = (vivid_rect) { 
@@ -131,12 +733,30 @@ vivid_context vivid_create(const char* title, Uint16 width, Uint16 height,
     // Create a colour buffer to be able to edit between frames
     size_t bs = sizeof(vivid_colour) * width * height;
     _context.window_buffer = (vivid_colour*) malloc(bs);
+    if (!_context.window_buffer)
+        VIVID_PANIC("VIVID couldn't allocate the window buffer", VIVID_FAIL);
 
     // Set the base colour (clear colour)
-    memset(_context.window_buffer, VIVID_BLACK.hex, bs);
+    _vivid_clear_buffer(_context.window_buffer, (size_t) width * height, 
+        _context.window_clear_colour);
+    _context._clear_value = _context.window_clear_colour;
 
-    // Initialise the SDL components
-    _vivid_intialise(&_context);
+    // Every tile starts up to date with clear generation 0
+    _context._tiles_x = (width + VIVID_TILE_SIZE - 1) / VIVID_TILE_SIZE;
+    _context._tiles_y = (height + VIVID_TILE_SIZE - 1) / VIVID_TILE_SIZE;
+    _context._tiles = (_vivid_clear_tile*) calloc(
+        _context._tiles_x * _context._tiles_y, sizeof(_vivid_clear_tile));
+    if (!_context._tiles)
+        VIVID_PANIC("VIVID couldn't allocate the clear tiles", VIVID_FAIL);
+
+    const int bins = _context._tiles_x * _context._tiles_y;
+    _context._batch.start = (Uint32*) malloc(sizeof(Uint32) * (bins + 1));
+    _context._batch.bounds = (_vivid_box*) malloc(sizeof(_vivid_box) * bins);
+    if (!_context._batch.start || !_context._batch.bounds)
+        VIVID_PANIC("VIVID couldn't allocate the batch bins", VIVID_FAIL);
+
+    // Nothing has been uploaded to the texture yet
+    _context._dirty_full = 1;
 
     return _context;
 }
@@ -151,8 +771,16 @@ Uint8 _vivid_intialise(vivid_context* context) {
     if (SDL_Init(SDL_INIT_VIDEO) < 0) 
         VIVID_PANIC("SDL2 couldn't initialise", VIVID_FAIL);
 
+    // Pick the fastest blend kernels this CPU supports
+    _vivid_select_kernels();
+
     // Base SDL creation
     _vivid_window_create(context);
+
+    // A pipelined context's renderer belongs to its present thread
+    if (context->_config.queue_depth > 1)
+        return _vivid_present_start(context);
+
     _vivid_renderer_create(context);
     _vivid_texture_create(context);
     
@@ -183,15 +811,20 @@ Uint8 _vivid_window_create(vivid_context* context) {
 }
 
 /*
- * Use SDL to create a renderer that will utilise software based renderering.
- * On failure the program will panic (exit) after printing the SDL error.
+ * Use SDL to create a renderer with the flags of the context's config, 
+ * software rendering unless asked otherwise. On failure the program will 
+ * panic (exit) after printing the SDL error.
  */
 Uint8 _vivid_renderer_create(vivid_context* context) {
+    Uint32 flags = context->_config.renderer_flags;
+    if (context->_config.vsync)
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+
     // Renderer Creation
     context->_renderer = SDL_CreateRenderer(
         context->_window,
         -1,
-        SDL_RENDERER_SOFTWARE
+        flags
     );
 
     // Check successful renderer creation
@@ -224,13 +857,39 @@ Uint8 _vivid_texture_create(vivid_context* context) {
 }
 
 /*
- * Clean the vivid context by destroying the SDL components.
+ * Clean the vivid context by destroying the SDL components and freeing the
+ * window buffer.
  */
 Uint8 vivid_clean(vivid_context* context) {
     VIVID_ASSERT_CONTEXT(context);
 
-    SDL_DestroyTexture(context->_texture);
-    SDL_DestroyRenderer(context->_renderer);
+    _vivid_deferred_destroy(context);
+    vivid_profile_enable(context, 0);
+    vivid_capture_stop(context);
+
+    // Frees every frame buffer, including the window buffer
+    _vivid_present_destroy(context);
+
+    free(context->window_buffer);
+    context->window_buffer = NULL;
+    free(context->_tiles);
+    context->_tiles = NULL;
+    free(context->_batch.items);
+    free(context->_batch.start);
+    free(context->_batch.bounds);
+    context->_batch = (_vivid_batch) { 0 };
+    free(context->_indices);
+    context->_indices = NULL;
+    free(context->_palette);
+    context->_palette = NULL;
+
+    if (context->_headless)
+        return VIVID_OK;
+
+    if (context->_texture)
+        SDL_DestroyTexture(context->_texture);
+    if (context->_renderer)
+        SDL_DestroyRenderer(context->_renderer);
     SDL_DestroyWindow(context->_window);
     SDL_Quit();
 
@@ -238,161 +897,4010 @@ Uint8 vivid_clean(vivid_context* context) {
 }
 
 /*
- * Clear the screen buffer setting the screen to the clear colour.
+ * Clear the window buffer to the clear colour. Anything recorded in deferred
+ * mode and not yet flushed is dropped, as it would be drawn over. Only the 
+ * tiles drawn to since the last clear are uploaded again, unless the clear
+ * colour changed. With lazy clearing (see `vivid_set_lazy_clear`) the 
+ * buffer is left alone and each tile is cleared when it is next needed.
  */
 Uint8 vivid_clear(vivid_context* context) {
     VIVID_ASSERT_CONTEXT(context);
 
-    // Clear Window
-    SDL_SetRenderDrawColor(
-        context->_renderer, 
-        context->window_clear_colour.r,
-        context->window_clear_colour.g,
-        context->window_clear_colour.b,
-        context->window_clear_colour.a
-    );
-    SDL_RenderClear(context->_renderer);
+    const Uint64 start = context->_profiler ? SDL_GetPerformanceCounter() : 0;
+    const vivid_colour c = context->window_clear_colour;
+    const int tiles = context->_tiles_x * context->_tiles_y;
+
+    if (context->_deferred) {
+        context->_deferred->command_count = 0;
+        _vivid_arena_reset(&context->_deferred->arena);
+    }
+
+    // Tiles drawn since the last clear no longer match the texture
+    if (c.hex != context->_clear_value.hex) {
+        context->_dirty_full = 1;
+    } else {
+        for (int t = 0; t < tiles; t++) {
+            if (context->_tiles[t].drawn != context->_clear_gen)
+                continue;
+
+            const int tx = (t % context->_tiles_x) * VIVID_TILE_SIZE;
+            const int ty = (t / context->_tiles_x) * VIVID_TILE_SIZE;
+            _vivid_dirty_add(context, _vivid_box_clip(
+                (_vivid_box) { 0, 0, context->window_size.w, 
+                    context->window_size.h },
+                (_vivid_box) { tx, ty, tx + VIVID_TILE_SIZE, 
+                    ty + VIVID_TILE_SIZE }));
+        }
+    }
+
+    context->_clear_value = c;
+    context->_clear_gen++;
+
+    // Pipelined contexts share the tile state between their buffers, so they
+    // always clear straight away, as does a wrapped generation counter. 
+    // Indexed contexts only clear their indices, a quarter of the memory
+    if (context->_indices) {
+        memset(context->_indices, c.r, 
+            (size_t) context->window_size.w * context->window_size.h);
+        for (int t = 0; t < tiles; t++)
+            context->_tiles[t].valid = context->_clear_gen;
+    } else if (!context->_lazy_clear || context->_present || 
+            !context->_clear_gen) {
+        _vivid_clear_buffer(context->window_buffer, 
+            (size_t) context->window_size.w * context->window_size.h, c);
+        for (int t = 0; t < tiles; t++)
+            context->_tiles[t].valid = context->_clear_gen;
+    }
+
+    // The present thread owns a pipelined context's renderer, and the 
+    // texture covers the whole window anyway
+    if (!context->_headless && !context->_present) {
+        SDL_SetRenderDrawColor(context->_renderer, c.r, c.g, c.b, c.a);
+        SDL_RenderClear(context->_renderer);
+    }
+
+    if (context->_profiler)
+        context->_profiler->current.clear_ns += _vivid_profile_ns(start);
+
+    return VIVID_OK;
+}
+
+/*
+ * Enable or disable lazy clearing. `vivid_clear` then only bumps a clear 
+ * generation, and a tile is filled with the clear colour when it is first
+ * drawn to or uploaded, so frames that touch a small part of the window
+ * don't pay for a full buffer write. Write to `window_buffer` through 
+ * `vivid_get_buffer`, which brings every tile up to date, and mark what 
+ * changed with `vivid_mark_dirty`. Pipelined contexts always clear eagerly.
+ */
+Uint8 vivid_set_lazy_clear(vivid_context* context, Uint8 enable) {
+    VIVID_ASSERT_CONTEXT(context);
 
+    // Fill any tiles still waiting so the buffer is complete again
+    if (!enable)
+        _vivid_tiles_ready(context, (_vivid_box) { 
+            0, 0, context->window_size.w, context->window_size.h 
+        });
+
+    context->_lazy_clear = enable;
     return VIVID_OK;
 }
 
 /*
- * Copy the context image buffer to the SDL screen buffer and present the 
- * new frame to the window.
+ * Copy the changed regions of the context image buffer to the SDL texture and
+ * present the new frame to the window. When most of the frame changed the
+ * whole buffer is uploaded in one go. Pipelined contexts hand the frame to 
+ * the present thread instead and continue in the next frame buffer, which
+ * starts out with the same contents.
  */
 Uint8 vivid_render(vivid_context* context) {
     VIVID_ASSERT_CONTEXT(context);
 
-    Uint32* pixels;
-    Uint32  pitch;
+    // Rasterise anything recorded in deferred mode
+    vivid_flush(context);
 
-    // Construct Frame
-    SDL_LockTexture(
-        context->_texture,
-        NULL,
-        (void**)&pixels,
-        (int*)&pitch
-    );
+    _vivid_profiler* prof = context->_profiler;
+    Uint64 start = prof ? SDL_GetPerformanceCounter() : 0;
 
-    // Set pixel colour
-    memcpy(pixels, context->window_buffer, sizeof(vivid_colour) * 
-        context->window_size.w * context->window_size.h);
+    // Hand the changed tiles to the capture writer before the dirty regions 
+    // are reset or a pipelined context moves to its next buffer
+    if (context->_capture) {
+        _vivid_capture_frame(context);
 
-    SDL_UnlockTexture(context->_texture);
+        if (prof) {
+            prof->current.capture_ns = _vivid_profile_ns(start);
+            start = SDL_GetPerformanceCounter();
+        }
+    }
+
+    if (context->_present) {
+        // The frame buffers handed to the present thread are in colour
+        if (context->_indices && context->_dirty_full) {
+            _vivid_expand(context, (_vivid_box) { 
+                0, 0, context->window_size.w, context->window_size.h 
+            });
+        } else if (context->_indices) {
+            for (int i = 0; i < context->_dirty_count; i++)
+                _vivid_expand(context, context->_dirty[i]);
+        }
+
+        _vivid_present_submit(context);
+    } else if (!context->_headless) {
+        // Lazily cleared tiles are filled before they are uploaded
+        if (context->_lazy_clear && context->_dirty_full) {
+            _vivid_tiles_ready(context, (_vivid_box) { 
+                0, 0, context->window_size.w, context->window_size.h 
+            });
+        } else if (context->_lazy_clear) {
+            for (int i = 0; i < context->_dirty_count; i++)
+                _vivid_tiles_ready(context, context->_dirty[i]);
+        }
+
+        // Construct Frame, indexed contexts are expanded on the way
+        _vivid_upload(context->_texture, context->window_buffer, 
+            context->_indices, context->_palette, context->window_size.w, 
+            context->window_size.h, context->_dirty, context->_dirty_count, 
+            context->_dirty_full);
+
+        if (prof) {
+            prof->current.upload_ns = _vivid_profile_ns(start);
+            start = SDL_GetPerformanceCounter();
+        }
+
+        // Render Frame
+        SDL_RenderCopy(context->_renderer, context->_texture, NULL, NULL);
+        SDL_RenderPresent(context->_renderer);
+
+        if (prof)
+            prof->current.present_ns = _vivid_profile_ns(start);
+
+        _vivid_pace(&context->_pace_next, context->_config.target_fps);
+    }
+
+    // Without a window the frame is finished once it is in the buffer
+    context->_dirty_count = 0;
+    context->_dirty_last = 0;
+    context->_dirty_full = 0;
 
-    // Render Frame
-    SDL_RenderCopy(context->_renderer, context->_texture, NULL, NULL);
-    SDL_RenderPresent(context->_renderer);
+    // Store the finished frame in the profiler ring buffer
+    if (prof) {
+        const Uint64 now = SDL_GetPerformanceCounter();
+        if (prof->last_render)
+            prof->current.frame_ns = _vivid_profile_ns(prof->last_render);
+        prof->last_render = now;
+
+        prof->frames[prof->head] = prof->current;
+        prof->head = (prof->head + 1) % VIVID_PROFILE_FRAMES;
+        if (prof->count < VIVID_PROFILE_FRAMES)
+            prof->count++;
+        prof->current = (vivid_frame_stats) { 0 };
+    }
 
     return VIVID_OK;
 }
 
-Uint8 vivid_set_clear_colour(vivid_context* context, vivid_colour c) {
+/*
+ * Finish any deferred drawing and return the window buffer, `w * h` pixels in
+ * the ABGR8888 format. The buffer stays owned by the context. Pipelined
+ * contexts switch buffers in `vivid_render`, so fetch it again every frame.
+ * Indexed contexts expand the whole frame into it, so it can be read but 
+ * changes to it are lost.
+ */
+vivid_colour* vivid_get_buffer(vivid_context* context) {
+    if (!context->window_buffer)
+        return NULL;
+
+    const _vivid_box window = (_vivid_box) { 
+        0, 0, context->window_size.w, context->window_size.h 
+    };
+
+    vivid_flush(context);
+    _vivid_tiles_ready(context, window);
+    if (context->_indices)
+        _vivid_expand(context, window);
+
+    return context->window_buffer;
+}
+
+/*
+ * Write the window buffer to the file at `path` exactly as it is stored in
+ * memory, 4 bytes per pixel (r, g, b, a) with rows top to bottom.
+ */
+Uint8 vivid_write_raw(vivid_context* context, const char* path) {
     VIVID_ASSERT_CONTEXT(context);
 
-    context->window_clear_colour = c;
+    vivid_get_buffer(context);
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return VIVID_FAIL;
+
+    const size_t n = (size_t) context->window_size.w * context->window_size.h;
+    const size_t written = fwrite(context->window_buffer, 
+        sizeof(vivid_colour), n, file);
+
+    if (fclose(file) != 0 || written != n)
+        return VIVID_FAIL;
+
     return VIVID_OK;
 }
 
 /*
- * Draw a single pixel at point `p` (x,y) with the colour of `c` to the window
- * buffer. If the colour `c` has an alpha less than 255, then it will alpha
- * blend the final colour accordingly.
+ * Write the window buffer to the file at `path` as a binary (P6) PPM image,
+ * dropping the alpha channel.
  */
-Uint8 vivid_draw_pixel(vivid_context* context, vivid_rect p, vivid_colour c) {
+Uint8 vivid_write_ppm(vivid_context* context, const char* path) {
     VIVID_ASSERT_CONTEXT(context);
 
-    // Don't render anything out of the window buffer
-    if (p.x >= context->window_size.w || p.y >= context->window_size.h)
+    vivid_get_buffer(context);
+
+    const int w = context->window_size.w;
+    const int h = context->window_size.h;
+
+    Uint8* row = (Uint8*) malloc(3 * w);
+    if (!row)
         return VIVID_FAIL;
 
-    const size_t index = p.y * context->window_size.w + p.x;
-    const vivid_colour buf = context->window_buffer[index];
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        free(row);
+        return VIVID_FAIL;
+    }
+
+    Uint8 status = fprintf(file, "P6\n%d %d\n255\n", w, h) > 0 ? 
+        VIVID_OK : VIVID_FAIL;
+
+    for (int y = 0; y < h && status == VIVID_OK; y++) {
+        const vivid_colour* src = context->window_buffer + y * w;
+        for (int x = 0; x < w; x++) {
+            row[3 * x + 0] = src[x].r;
+            row[3 * x + 1] = src[x].g;
+            row[3 * x + 2] = src[x].b;
+        }
+
+        if (fwrite(row, 3, w, file) != (size_t) w)
+            status = VIVID_FAIL;
+    }
+
+    if (fclose(file) != 0)
+        status = VIVID_FAIL;
+    free(row);
 
-    vivid_colour final_colour;
-    const float a = c.a / 255.0f;
-    const float ca = 1.0f - a;
+    return status;
+}
+
+Uint8 vivid_set_clear_colour(vivid_context* context, vivid_colour c) {
+    VIVID_ASSERT_CONTEXT(context);
 
-    // Alpha blend new colour onto previous colour
-    final_colour.r = (a * (float)c.r) + (ca * (float)buf.r);
-    final_colour.g = (a * (float)c.g) + (ca * (float)buf.g);
-    final_colour.b = (a * (float)c.b) + (ca * (float)buf.b);
-    final_colour.a = 255;
+    context->window_clear_colour = c;
+    return VIVID_OK;
+}
 
-    // Place main pixel
-    context->window_buffer[index] = final_colour;
+/*
+ * Mark the rect `p` of the window buffer as changed so it is uploaded on the
+ * next `vivid_render`. Only needed after writing to `window_buffer` directly,
+ * the draw functions track the regions they touch.
+ */
+Uint8 vivid_mark_dirty(vivid_context* context, vivid_rect p) {
+    VIVID_ASSERT_CONTEXT(context);
 
+    const _vivid_box b = _vivid_clip_rect(context, p);
+    _vivid_tiles_touch(context, b);
+    _vivid_dirty_add(context, b);
     return VIVID_OK;
 }
 
 /*
- * Render a filled rectangle at point and size `p` (x, y, width, height) with
- * colour of `c`. If part of the rectangle is outside the window buffer then it
- * will draw all the pixels instead. 
+ * Force the next `vivid_render` to upload the whole window buffer.
  */
-Uint8 vivid_draw_rect(vivid_context* context, vivid_rect p, vivid_colour c) {
+Uint8 vivid_invalidate(vivid_context* context) {
     VIVID_ASSERT_CONTEXT(context);
 
-    for (Uint16 y = p.y; y < p.y + p.h; y++) {
-        for (Uint16 x = p.x; x < p.x + p.w; x++) {
-            vivid_draw_pixel(context, VIVID_POINT(x, y), c);
-        }
+    context->_dirty_full = 1;
+    return VIVID_OK;
+}
+
+/*
+ * Switch the context to drawing 8-bit palette indices instead of colours, or
+ * back. Draws then store index `c.r` of their colour, make it with 
+ * `VIVID_INDEX`, and any alpha above zero is drawn solid. The palette is only
+ * applied while uploading the changed regions, so a palette change shows up
+ * without drawing anything again. Starts with `VIVID_BLACK` to 
+ * `VIVID_BRIGHT_WHITE` as indices 0 to 15 and the clear colour's index 
+ * everywhere. Sprites can't be drawn and anti-aliased lines are drawn 
+ * aliased. Switching back keeps the frame in colour.
+ */
+Uint8 vivid_set_indexed(vivid_context* context, Uint8 enable) {
+    VIVID_ASSERT_CONTEXT(context);
+
+    const _vivid_box window = (_vivid_box) { 
+        0, 0, context->window_size.w, context->window_size.h 
+    };
+    const size_t n = (size_t) context->window_size.w * context->window_size.h;
+
+    if (!enable == !context->_indices)
+        return VIVID_OK;
+
+    // Anything recorded is drawn in the mode it was recorded in
+    vivid_flush(context);
+
+    if (!enable) {
+        _vivid_expand(context, window);
+        free(context->_indices);
+        free(context->_palette);
+        context->_indices = NULL;
+        context->_palette = NULL;
+        return VIVID_OK;
     }
 
+    // Lazily cleared tiles are no longer filled once indexed
+    _vivid_tiles_ready(context, window);
+
+    context->_indices = (Uint8*) malloc(n);
+    context->_palette = (Uint32*) calloc(256, sizeof(Uint32));
+    if (!context->_indices || !context->_palette)
+        VIVID_PANIC("VIVID couldn't allocate the index buffer", VIVID_FAIL);
+
+    const vivid_colour ansi[16] = {
+        VIVID_BLACK, VIVID_RED, VIVID_GREEN, VIVID_YELLOW, VIVID_BLUE, 
+        VIVID_MAGENTA, VIVID_CYAN, VIVID_WHITE, VIVID_BRIGHT_BLACK, 
+        VIVID_BRIGHT_RED, VIVID_BRIGHT_GREEN, VIVID_BRIGHT_YELLOW, 
+        VIVID_BRIGHT_BLUE, VIVID_BRIGHT_MAGENTA, VIVID_BRIGHT_CYAN, 
+        VIVID_BRIGHT_WHITE
+    };
+    for (int i = 0; i < 256; i++)
+        context->_palette[i] = i < 16 ? ansi[i].hex : VIVID_BLACK.hex;
+
+    memset(context->_indices, context->window_clear_colour.r, n);
+    context->_clear_value = context->window_clear_colour;
+    context->_dirty_full = 1;
+
     return VIVID_OK;
 }
 
 /*
- * Render a line from point `p0` to `p1` (x, y) with colour `c`. This uses the 
- * Bresenham's line algorithm. If part of the line is outside the window buffer
- * then it will render all the points that are in the window buffer.
+ * Replace the `count` palette entries from index `first` on with `colours`.
+ * The whole frame is expanded again on the next `vivid_render`.
  */
-Uint8 vivid_draw_line(vivid_context* context, vivid_rect p0, vivid_rect p1, 
-        vivid_colour c) {
+Uint8 vivid_set_palette(vivid_context* context, Uint8 first, 
+        const vivid_colour* colours, Uint16 count) {
 
     VIVID_ASSERT_CONTEXT(context);
 
-    int dx, dy, sx, sy, err, e2;
+    if (!context->_palette || count > 256 - first)
+        return VIVID_FAIL;
+
+    for (int i = 0; i < count; i++)
+        context->_palette[first + i] = colours[i].hex;
 
-    dx = abs(p1.x - p0.x);
-    sx = p0.x < p1.x ? 1 : -1;
-    dy = -abs(p1.y - p0.y);
-    sy = p0.y < p1.y ? 1 : -1;
-    err = dx + dy;
+    context->_dirty_full = 1;
+    return VIVID_OK;
+}
 
-    while (1) {
-        vivid_draw_pixel(context, p0, c); // Change to weighted pixel later
-        if (p0.x == p1.x && p0.y == p1.y) break;
+/*
+ * Finish any deferred drawing and return the index buffer of an indexed 
+ * context, `w * h` bytes, or NULL when the context isn't indexed. Mark what
+ * is written with `vivid_mark_dirty`.
+ */
+Uint8* vivid_get_index_buffer(vivid_context* context) {
+    if (!context->_indices)
+        return NULL;
 
-        e2 = 2 * err;
-        if (e2 >= dy) {
-            err += dy;
-            p0.x += sx;
-        }
-        if (e2 <= dx) {
-            err += dx;
-            p0.y += sy;
-        }
-    }
+    vivid_flush(context);
+    return context->_indices;
+}
+
+/*
+ * Expand the box `b` of an indexed context's indices into its window buffer.
+ */
+void _vivid_expand(vivid_context* context, _vivid_box b) {
+    const int stride = context->window_size.w;
 
-    return VIVID_OK;    
+    for (int y = b.y0; y < b.y1; y++)
+        _vivid_expand_impl(&context->window_buffer[y * stride + b.x0].hex, 
+            context->_indices + y * stride + b.x0, b.x1 - b.x0, 
+            context->_palette);
 }
 
 /*
- * Render a sprite (colour buffer) at point `p` of size `p`. Vivid won't render
- * any points outside the window buffer, but will partially render.
+ * Store `index` in the `n` pixels of `dst` whose coverage in `mask` is at 
+ * least half.
  */
-Uint8 vivid_draw_sprite(vivid_context* context, vivid_rect p, 
-        vivid_colour* buf) {
+void _vivid_index_mask_row(Uint8* dst, const Uint8* mask, int n, 
+        Uint8 index) {
 
+    for (int i = 0; i < n; i++) {
+        if (mask[i] >= 128)
+            dst[i] = index;
+    }
+}
+
+/*
+ * Draw a single pixel at point `p` (x,y) with the colour of `c` to the window
+ * buffer. If the colour `c` has an alpha less than 255, then it will alpha
+ * blend the final colour accordingly, an alpha of 0 draws nothing.
+ */
+Uint8 vivid_draw_pixel(vivid_context* context, vivid_rect p, vivid_colour c) {
     VIVID_ASSERT_CONTEXT(context);
 
-    for (int y = 0; y < p.h; y++) {
-        for (int x = 0; x < p.w; x++) {
-            vivid_draw_pixel(context, VIVID_POINT(p.x + x, p.y + y), 
-                buf[y * p.w + x]);
-        }
-    }
+    // Don't render anything out of the window buffer
+    if (p.x < 0 || p.y < 0 || 
+        p.x >= context->window_size.w || p.y >= context->window_size.h)
+        return VIVID_FAIL;
 
-    return VIVID_OK;
-}
\ No newline at end of file
+    if (c.a == 0)
+        return VIVID_OK;
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_PIXEL,
+        .colour = c,
+        .bounds = { p.x, p.y, p.x + 1, p.y + 1 }
+    });
+}
+
+/*
+ * Render a filled rectangle at point and size `p` (x, y, width, height) with
+ * colour of `c`. The rectangle is clipped to the window buffer once and then
+ * filled a row span at a time, so any part outside the window is never 
+ * visited. Opaque colours are stored directly, translucent colours are alpha
+ * blended onto the buffer.
+ */
+Uint8 vivid_draw_rect(vivid_context* context, vivid_rect p, vivid_colour c) {
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (c.a == 0)
+        return VIVID_OK;
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_RECT,
+        .colour = c,
+        .bounds = _vivid_clip_rect(context, p)
+    });
+}
+
+/*
+ * Render a line from point `p0` to `p1` (x, y) with colour `c`. The line is
+ * clipped to the window buffer before it is rasterised, so the cost only 
+ * depends on the visible part. Horizontal lines are filled as a single span
+ * and vertical lines as a single column.
+ */
+Uint8 vivid_draw_line(vivid_context* context, vivid_rect p0, vivid_rect p1, 
+        vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (c.a == 0)
+        return VIVID_OK;
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_LINE,
+        .colour = c,
+        .bounds = _vivid_line_bounds(context, p0.x, p0.y, p1.x, p1.y, 0),
+        .line = { p0.x, p0.y, p1.x, p1.y, 0, 0 }
+    });
+}
+
+/*
+ * Render a polyline through the `count` points `p` with colour `c`. Points
+ * shared by two segments are only drawn once, including the start of a 
+ * closed polyline whose last point equals its first, so translucent 
+ * polylines have no darker joints.
+ */
+Uint8 vivid_draw_lines(vivid_context* context, const vivid_rect* p, 
+        Uint32 count, vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (c.a == 0)
+        return VIVID_OK;
+
+    // A single point is still drawn
+    if (count == 1)
+        return vivid_draw_line(context, p[0], p[0], c);
+
+    // The closing segment stops short of the already drawn first point
+    const Uint8 closed = count > 2 && p[count - 1].x == p[0].x && 
+        p[count - 1].y == p[0].y;
+
+    for (Uint32 i = 1; i < count; i++) {
+        _vivid_submit(context, &(_vivid_command) {
+            .type = VIVID_COMMAND_LINE,
+            .colour = c,
+            .bounds = _vivid_line_bounds(context, p[i - 1].x, p[i - 1].y, 
+                p[i].x, p[i].y, 0),
+            .line = { p[i - 1].x, p[i - 1].y, p[i].x, p[i].y, i > 1, 
+                closed && i == count - 1 }
+        });
+    }
+
+    return VIVID_OK;
+}
+
+/*
+ * Render an anti-aliased line from point `p0` to `p1` with colour `c` using
+ * Xiaolin Wu's algorithm in 16.16 fixed point. Each step along the line 
+ * splits the colour's alpha between the two pixels either side of it.
+ */
+Uint8 vivid_draw_line_aa(vivid_context* context, vivid_rect p0, 
+        vivid_rect p1, vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (c.a == 0)
+        return VIVID_OK;
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_LINE_AA,
+        .colour = c,
+        .bounds = _vivid_line_bounds(context, p0.x, p0.y, p1.x, p1.y, 1),
+        .line = { p0.x, p0.y, p1.x, p1.y, 0 }
+    });
+}
+
+/*
+ * Render a sprite (colour buffer) at point `p` of size `p`. Vivid won't render
+ * any points outside the window buffer, but will partially render. Each 
+ * visible row of the sprite is alpha blended in one pass. Sprites drawn every
+ * frame should be prepared with `vivid_sprite_create` instead. In deferred 
+ * mode `buf` must stay valid until the next `vivid_flush` or `vivid_render`.
+ */
+Uint8 vivid_draw_sprite(vivid_context* context, vivid_rect p, 
+        vivid_colour* buf) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    // Sprite colours have no palette index
+    if (context->_indices)
+        return VIVID_FAIL;
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_SPRITE,
+        .bounds = _vivid_clip_rect(context, p),
+        .sprite = { p.x, p.y, p.w, p.h, buf }
+    });
+}
+
+/*
+ * Draw the `count` points (`x[i]`, `y[i]`), each with `colours[i]`, or all 
+ * with `c` when `colours` is NULL. The context is checked once, points 
+ * outside the window and transparent ones are skipped and the rest are 
+ * counting sorted by band of rows, so the buffer is written a band at a time.
+ * The sort is stable, points on the same pixel are drawn in the order given
+ * just like calling `vivid_draw_pixel` for each. The arrays can be reused 
+ * straight away, even in deferred mode.
+ */
+Uint8 vivid_draw_points(vivid_context* context, const Sint16* x, 
+        const Sint16* y, Uint32 count, const vivid_colour* colours, 
+        vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (!colours && c.a == 0)
+        return VIVID_OK;
+
+    const Uint32 w = context->window_size.w, h = context->window_size.h;
+    Uint32* start = _vivid_batch_begin(context, 1);
+    const int cols = context->_batch.cols;
+    Uint32 n = 0;
+
+    // Count the points per bin, then place them in bin order
+    for (Uint32 i = 0; i < count; i++) {
+        if ((Uint32) x[i] >= w || (Uint32) y[i] >= h || 
+                (colours && colours[i].a == 0))
+            continue;
+
+        start[(y[i] / VIVID_TILE_SIZE) * cols + 
+            (cols > 1 ? x[i] / VIVID_TILE_SIZE : 0) + 1]++;
+        n++;
+    }
+
+    _vivid_batch_item* items = _vivid_batch_alloc(context, n);
+    if (!items)
+        return VIVID_OK;
+
+    for (Uint32 i = 0; i < count; i++) {
+        if ((Uint32) x[i] >= w || (Uint32) y[i] >= h || 
+                (colours && colours[i].a == 0))
+            continue;
+
+        const int t = (y[i] / VIVID_TILE_SIZE) * cols + 
+            (cols > 1 ? x[i] / VIVID_TILE_SIZE : 0);
+        items[start[t]++] = (_vivid_batch_item) { 
+            VIVID_POINT(x[i], y[i]), colours ? colours[i] : c 
+        };
+
+        _vivid_box* b = &context->_batch.bounds[t];
+        if (x[i] < b->x0) b->x0 = x[i];
+        if (y[i] < b->y0) b->y0 = y[i];
+        if (x[i] >= b->x1) b->x1 = x[i] + 1;
+        if (y[i] >= b->y1) b->y1 = y[i] + 1;
+    }
+
+    return _vivid_batch_submit(context, VIVID_COMMAND_POINTS, items, NULL);
+}
+
+/*
+ * Draw the `count` filled rects `p`, each with `colours[i]`, or all with `c`
+ * when `colours` is NULL. Like `vivid_draw_points` the context is checked 
+ * once and the clipped rects are sorted by band of rows, a rect crossing 
+ * bands is split between them. Overlapping rects blend in the order given.
+ */
+Uint8 vivid_draw_rects(vivid_context* context, const vivid_rect* p, 
+        Uint32 count, const vivid_colour* colours, vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (!colours && c.a == 0)
+        return VIVID_OK;
+
+    return _vivid_batch_boxes(context, VIVID_COMMAND_RECTS, p, NULL, NULL, 
+        count, colours, c, NULL);
+}
+
+/*
+ * Blit the prepared sprite with its top left corner at each of the `count` 
+ * points (`x[i]`, `y[i]`), checking the context once. Splitting sprites 
+ * between bands costs more than it saves, so they are drawn in the order 
+ * given and only sorted into tiles in deferred mode. The sprite must stay 
+ * valid until the next `vivid_flush` or `vivid_render` in deferred mode.
+ */
+Uint8 vivid_draw_sprites(vivid_context* context, const Sint16* x, 
+        const Sint16* y, Uint32 count, const vivid_sprite* sprite) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    // Sprite colours have no palette index
+    if (context->_indices)
+        return VIVID_FAIL;
+
+    return _vivid_batch_boxes(context, VIVID_COMMAND_SPRITES, NULL, x, y, 
+        count, NULL, VIVID_BLACK, sprite);
+}
+
+/*
+ * Sort the boxes of a batch of rects `p`, or of `sprite` at each point 
+ * (`x[i]`, `y[i]`), into bins and submit them. Boxes inside a single bin, 
+ * the usual case for small ones, are counted and placed inline.
+ */
+Uint8 _vivid_batch_boxes(vivid_context* context, Uint8 type, 
+        const vivid_rect* p, const Sint16* x, const Sint16* y, Uint32 count, 
+        const vivid_colour* colours, vivid_colour c, 
+        const vivid_sprite* sprite) {
+
+    Uint32* start = _vivid_batch_begin(context, !sprite);
+    const int cols = context->_batch.cols, rows = context->_batch.rows;
+    Uint32 n = 0;
+
+    for (Uint32 i = 0; i < count; i++) {
+        const _vivid_box b = _vivid_clip_rect(context, p ? p[i] : 
+            VIVID_RECT1(x[i], y[i], sprite->w, sprite->h));
+        if (b.x0 >= b.x1 || b.y0 >= b.y1 || (colours && colours[i].a == 0))
+            continue;
+
+        const int tx = cols > 1 ? b.x0 / VIVID_TILE_SIZE : 0;
+        const int ty = rows > 1 ? b.y0 / VIVID_TILE_SIZE : 0;
+        if ((cols == 1 || (b.x1 - 1) / VIVID_TILE_SIZE == tx) && 
+                (rows == 1 || (b.y1 - 1) / VIVID_TILE_SIZE == ty)) {
+            start[ty * cols + tx + 1]++;
+            n++;
+        } else {
+            n += _vivid_batch_count(context, b);
+        }
+    }
+
+    _vivid_batch_item* items = _vivid_batch_alloc(context, n);
+    if (!items)
+        return VIVID_OK;
+
+    for (Uint32 i = 0; i < count; i++) {
+        const _vivid_box b = _vivid_clip_rect(context, p ? p[i] : 
+            VIVID_RECT1(x[i], y[i], sprite->w, sprite->h));
+        if (b.x0 >= b.x1 || b.y0 >= b.y1 || (colours && colours[i].a == 0))
+            continue;
+
+        // Rects keep their clipped box, sprites their origin
+        const _vivid_batch_item item = { 
+            p ? VIVID_RECT0(b.x0, b.y0, b.x1, b.y1) : VIVID_POINT(x[i], y[i]),
+            colours ? colours[i] : c 
+        };
+
+        const int tx = cols > 1 ? b.x0 / VIVID_TILE_SIZE : 0;
+        const int ty = rows > 1 ? b.y0 / VIVID_TILE_SIZE : 0;
+        if ((cols > 1 && (b.x1 - 1) / VIVID_TILE_SIZE != tx) || 
+                (rows > 1 && (b.y1 - 1) / VIVID_TILE_SIZE != ty)) {
+            _vivid_batch_place(context, items, b, item);
+            continue;
+        }
+
+        const int t = ty * cols + tx;
+        items[start[t]++] = item;
+
+        _vivid_box* bounds = &context->_batch.bounds[t];
+        if (b.x0 < bounds->x0) bounds->x0 = b.x0;
+        if (b.y0 < bounds->y0) bounds->y0 = b.y0;
+        if (b.x1 > bounds->x1) bounds->x1 = b.x1;
+        if (b.y1 > bounds->y1) bounds->y1 = b.y1;
+    }
+
+    return _vivid_batch_submit(context, type, items, sprite);
+}
+
+/*
+ * Start sorting a batch, returns the item count of each bin zeroed. Bin `t` 
+ * counts into slot `t + 1`, so the slots become each bin's first item in 
+ * place. Immediate batches are binned by band of rows when `bands` is set 
+ * and kept whole otherwise, deferred ones are binned per tile so each worker 
+ * only sees the items of its own tiles.
+ */
+Uint32* _vivid_batch_begin(vivid_context* context, Uint8 bands) {
+    _vivid_batch* batch = &context->_batch;
+
+    batch->cols = context->_deferred ? context->_tiles_x : 1;
+    batch->rows = context->_deferred || bands ? context->_tiles_y : 1;
+    memset(batch->start, 0, sizeof(Uint32) * (batch->cols * batch->rows + 1));
+
+    return batch->start;
+}
+
+/*
+ * Count an item covering the clipped box `b` in every bin it overlaps, 
+ * returns the number of bins.
+ */
+Uint32 _vivid_batch_count(vivid_context* context, _vivid_box b) {
+    _vivid_batch* batch = &context->_batch;
+
+    const int tx0 = batch->cols > 1 ? b.x0 / VIVID_TILE_SIZE : 0;
+    const int tx1 = batch->cols > 1 ? (b.x1 - 1) / VIVID_TILE_SIZE : 0;
+    const int ty0 = batch->rows > 1 ? b.y0 / VIVID_TILE_SIZE : 0;
+    const int ty1 = batch->rows > 1 ? (b.y1 - 1) / VIVID_TILE_SIZE : 0;
+
+    for (int ty = ty0; ty <= ty1; ty++)
+        for (int tx = tx0; tx <= tx1; tx++)
+            batch->start[ty * batch->cols + tx + 1]++;
+
+    return (Uint32) ((ty1 - ty0 + 1) * (tx1 - tx0 + 1));
+}
+
+/*
+ * Turn the bin counts into the first item of each bin and reserve the `n`
+ * items of the batch, NULL if there are none. Deferred batches live in the 
+ * frame arena until they are flushed, immediate ones reuse the context's 
+ * scratch space.
+ */
+_vivid_batch_item* _vivid_batch_alloc(vivid_context* context, Uint32 n) {
+    _vivid_batch* batch = &context->_batch;
+    const int bins = batch->cols * batch->rows;
+
+    if (!n)
+        return NULL;
+
+    // Bounds start inverted so the first item sets them
+    for (int t = 0; t < bins; t++) {
+        batch->start[t + 1] += batch->start[t];
+        batch->bounds[t] = (_vivid_box) { 
+            context->window_size.w, context->window_size.h, 0, 0 
+        };
+    }
+
+    if (context->_deferred)
+        return (_vivid_batch_item*) _vivid_arena_alloc(
+            &context->_deferred->arena, sizeof(_vivid_batch_item) * n);
+
+    if (n > batch->capacity) {
+        Uint32 capacity = batch->capacity ? batch->capacity : 1024;
+        while (capacity < n)
+            capacity *= 2;
+
+        free(batch->items);
+        batch->items = (_vivid_batch_item*) malloc(
+            sizeof(_vivid_batch_item) * capacity);
+        if (!batch->items)
+            VIVID_PANIC("VIVID couldn't grow the batch", VIVID_FAIL);
+
+        batch->capacity = capacity;
+    }
+
+    return batch->items;
+}
+
+/*
+ * Append `item`, covering the clipped box `b`, to every bin it overlaps and
+ * grow the bounds of those bins by the part of `b` inside them.
+ */
+void _vivid_batch_place(vivid_context* context, _vivid_batch_item* items, 
+        _vivid_box b, _vivid_batch_item item) {
+
+    _vivid_batch* batch = &context->_batch;
+
+    const int tx0 = batch->cols > 1 ? b.x0 / VIVID_TILE_SIZE : 0;
+    const int tx1 = batch->cols > 1 ? (b.x1 - 1) / VIVID_TILE_SIZE : 0;
+    const int ty0 = batch->rows > 1 ? b.y0 / VIVID_TILE_SIZE : 0;
+    const int ty1 = batch->rows > 1 ? (b.y1 - 1) / VIVID_TILE_SIZE : 0;
+
+    for (int ty = ty0; ty <= ty1; ty++) {
+        for (int tx = tx0; tx <= tx1; tx++) {
+            const int t = ty * batch->cols + tx;
+            items[batch->start[t]++] = item;
+
+            // Bins only split the axes they are sorted along
+            _vivid_box r = b;
+            if (batch->cols > 1) {
+                if (r.x0 < tx * VIVID_TILE_SIZE) r.x0 = tx * VIVID_TILE_SIZE;
+                if (r.x1 > (tx + 1) * VIVID_TILE_SIZE) 
+                    r.x1 = (tx + 1) * VIVID_TILE_SIZE;
+            }
+            if (batch->rows > 1) {
+                if (r.y0 < ty * VIVID_TILE_SIZE) r.y0 = ty * VIVID_TILE_SIZE;
+                if (r.y1 > (ty + 1) * VIVID_TILE_SIZE) 
+                    r.y1 = (ty + 1) * VIVID_TILE_SIZE;
+            }
+
+            _vivid_box* bounds = &batch->bounds[t];
+            if (r.x0 < bounds->x0) bounds->x0 = r.x0;
+            if (r.y0 < bounds->y0) bounds->y0 = r.y0;
+            if (r.x1 > bounds->x1) bounds->x1 = r.x1;
+            if (r.y1 > bounds->y1) bounds->y1 = r.y1;
+        }
+    }
+}
+
+/*
+ * Submit one command per bin holding items of the batch. Placing the items
+ * moved each bin's start on to the next bin's, so bin `t` owns 
+ * items[start[t - 1]..start[t]].
+ */
+Uint8 _vivid_batch_submit(vivid_context* context, Uint8 type, 
+        const _vivid_batch_item* items, const vivid_sprite* sprite) {
+
+    const _vivid_batch* batch = &context->_batch;
+    const int bins = batch->cols * batch->rows;
+    Uint32 first = 0;
+
+    for (int t = 0; t < bins; t++) {
+        if (batch->start[t] == first)
+            continue;
+
+        _vivid_submit(context, &(_vivid_command) {
+            .type = type,
+            .bounds = batch->bounds[t],
+            .batch = { items + first, batch->start[t] - first, sprite }
+        });
+        first = batch->start[t];
+    }
+
+    return VIVID_OK;
+}
+
+/*
+ * Draw the items of a batched command that fall inside `b`.
+ */
+void _vivid_raster_batch(vivid_context* context, 
+        const _vivid_command* command, _vivid_box b) {
+
+    const _vivid_batch_item* item = command->batch.items;
+    const _vivid_batch_item* end = item + command->batch.count;
+    const vivid_sprite* sprite = command->batch.sprite;
+    const int stride = context->window_size.w;
+
+    if (command->type == VIVID_COMMAND_POINTS) {
+        for (; item < end; item++) {
+            const int x = item->p.x, y = item->p.y;
+            if (x < b.x0 || x >= b.x1 || y < b.y0 || y >= b.y1)
+                continue;
+
+            vivid_colour* px = context->window_buffer + y * stride + x;
+            if (context->_indices)
+                context->_indices[y * stride + x] = item->colour.r;
+            else if (item->colour.a == 255)
+                *px = item->colour;
+            else
+                px->hex = _vivid_blend_pixel(px->hex, item->colour.hex);
+        }
+        return;
+    }
+
+    for (; item < end; item++) {
+        const int w = sprite ? sprite->w : item->p.w;
+        const int h = sprite ? sprite->h : item->p.h;
+        const _vivid_box r = _vivid_box_clip(b, (_vivid_box) { 
+            item->p.x, item->p.y, item->p.x + w, item->p.y + h 
+        });
+        if (r.x0 >= r.x1 || r.y0 >= r.y1)
+            continue;
+
+        if (sprite) {
+            _vivid_raster_prepared(context, sprite, item->p.x, item->p.y, r);
+        } else {
+            for (int y = r.y0; y < r.y1; y++)
+                _vivid_span(context, r.x0, y, r.x1 - r.x0, item->colour);
+        }
+    }
+}
+
+/*
+ * Render the `w` by `h` sprite `buf` scaled to fill the rect `p`, sampling
+ * with `filter` (VIVID_FILTER_NEAREST or VIVID_FILTER_BILINEAR). Only the 
+ * part of `p` inside the window is visited, stepping through the source in
+ * 16.16 fixed point. In deferred mode `buf` must stay valid until the next
+ * `vivid_flush` or `vivid_render`.
+ */
+Uint8 vivid_draw_sprite_scaled(vivid_context* context, vivid_rect p, 
+        const vivid_colour* buf, Uint16 w, Uint16 h, Uint8 filter) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    // Sprite colours have no palette index
+    if (context->_indices)
+        return VIVID_FAIL;
+
+    if (!p.w || !p.h || !w || !h)
+        return VIVID_OK;
+
+    const Sint32 dudx = (Sint32) (((Sint64) w << 16) / p.w);
+    const Sint32 dvdy = (Sint32) (((Sint64) h << 16) / p.h);
+
+    // Sample at pixel centres
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_AFFINE,
+        .bounds = _vivid_clip_rect(context, p),
+        .affine = { 
+            buf, w, h, 
+            dudx / 2 - (Sint64) p.x * dudx, dvdy / 2 - (Sint64) p.y * dvdy,
+            dudx, 0, 0, dvdy, filter 
+        }
+    });
+}
+
+/*
+ * Render the `p.w` by `p.h` sprite `buf` rotated clockwise by `angle` 
+ * radians and scaled by `scale` around its centre, which is placed at
+ * (`p.x`, `p.y`). Each row of the clipped bounding box only visits the
+ * pixels that map inside the sprite. In deferred mode `buf` must stay valid
+ * until the next `vivid_flush` or `vivid_render`.
+ */
+Uint8 vivid_draw_sprite_rotated(vivid_context* context, vivid_rect p, 
+        const vivid_colour* buf, double angle, double scale, Uint8 filter) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    // Sprite colours have no palette index
+    if (context->_indices)
+        return VIVID_FAIL;
+
+    // The 16.16 source steps have to fit in 32 bits
+    if (scale < 1.0 / 16384.0)
+        return VIVID_FAIL;
+    if (!p.w || !p.h)
+        return VIVID_OK;
+
+    const double ca = SDL_cos(angle), sa = SDL_sin(angle);
+    const double c = ca / scale, s = sa / scale;
+    const double cu = p.w * 0.5, cv = p.h * 0.5;
+
+    // Half extents of the rotated sprite, padded for rounding below
+    const double ex = (SDL_fabs(ca) * cu + SDL_fabs(sa) * cv) * scale;
+    const double ey = (SDL_fabs(sa) * cu + SDL_fabs(ca) * cv) * scale;
+    if (ex > 65536.0 || ey > 65536.0)
+        return VIVID_FAIL;
+
+    const _vivid_box window = (_vivid_box) { 
+        0, 0, context->window_size.w, context->window_size.h 
+    };
+
+    // Steps from one pixel to the next in the sprite
+    const Sint32 dudx = (Sint32) SDL_floor(c * 65536.0 + 0.5);
+    const Sint32 dudy = (Sint32) SDL_floor(s * 65536.0 + 0.5);
+    const Sint32 dvdx = -dudy, dvdy = dudx;
+
+    // Source position of the centre of pixel `p`, then moved back to (0, 0)
+    // in whole steps so the mapping doesn't change with the position
+    const Sint64 u = (Sint64) SDL_floor((cu + 0.5 * (c + s)) * 65536.0 + 0.5);
+    const Sint64 v = (Sint64) SDL_floor((cv + 0.5 * (c - s)) * 65536.0 + 0.5);
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_AFFINE,
+        .bounds = _vivid_box_clip(window, (_vivid_box) {
+            (int) SDL_floor(p.x - ex) - 1, (int) SDL_floor(p.y - ey) - 1,
+            (int) SDL_ceil(p.x + ex) + 1, (int) SDL_ceil(p.y + ey) + 1
+        }),
+        .affine = {
+            buf, p.w, p.h,
+            u - (Sint64) p.x * dudx - (Sint64) p.y * dudy,
+            v - (Sint64) p.x * dvdx - (Sint64) p.y * dvdy,
+            dudx, dvdx, dudy, dvdy, filter
+        }
+    });
+}
+
+/*
+ * Fill the triangle with corners `p0`, `p1` and `p2` (x, y) with colour `c`.
+ * Pixels are inside when their centre is, pixels exactly on an edge belong
+ * to the triangle only for top and left edges. Triangles sharing an edge 
+ * never both draw a pixel on it, so meshes blend without seams or overlap.
+ */
+Uint8 vivid_draw_triangle(vivid_context* context, vivid_rect p0, 
+        vivid_rect p1, vivid_rect p2, vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (c.a == 0)
+        return VIVID_OK;
+
+    return _vivid_submit_triangle(context, p0.x, p0.y, p1.x, p1.y, p2.x, p2.y,
+        c);
+}
+
+/*
+ * Fill the convex polygon through the `count` points `p` with colour `c`, as
+ * a fan of triangles around the first point. The fill rule of 
+ * `vivid_draw_triangle` keeps the triangles from overlapping, so translucent
+ * polygons are blended once per pixel.
+ */
+Uint8 vivid_draw_polygon(vivid_context* context, const vivid_rect* p, 
+        Uint32 count, vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (c.a == 0)
+        return VIVID_OK;
+
+    for (Uint32 i = 2; i < count; i++)
+        _vivid_submit_triangle(context, p[0].x, p[0].y, p[i - 1].x, 
+            p[i - 1].y, p[i].x, p[i].y, c);
+
+    return VIVID_OK;
+}
+
+/*
+ * Fill the circle of radius `r` centred on point `p` with colour `c`. 
+ */
+Uint8 vivid_draw_circle(vivid_context* context, vivid_rect p, Uint16 r, 
+        vivid_colour c) {
+
+    return vivid_draw_ellipse(context, VIVID_RECT1(p.x, p.y, r, r), c);
+}
+
+/*
+ * Fill the ellipse centred on (`p.x`, `p.y`) with radii `p.w` and `p.h` with
+ * colour `c`. Pixels whose centre is inside the ellipse are drawn, every row
+ * is a single span found with integer math only.
+ */
+Uint8 vivid_draw_ellipse(vivid_context* context, vivid_rect p, 
+        vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (c.a == 0)
+        return VIVID_OK;
+
+    const _vivid_box window = (_vivid_box) { 
+        0, 0, context->window_size.w, context->window_size.h 
+    };
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_ELLIPSE,
+        .colour = c,
+        .bounds = _vivid_box_clip(window, (_vivid_box) {
+            p.x - p.w, p.y - p.h, p.x + p.w + 1, p.y + p.h + 1
+        }),
+        .ellipse = { p.x, p.y, p.w, p.h }
+    });
+}
+
+/*
+ * Turn per frame profiling on or off. While enabled, every `vivid_render` 
+ * stores the time spent drawing, clearing, uploading and presenting plus the
+ * number of primitives and pixels drawn into a ring buffer of the last
+ * `VIVID_PROFILE_FRAMES` frames. The buffer is allocated once here, nothing
+ * is allocated per frame. Disabling frees the collected statistics.
+ */
+Uint8 vivid_profile_enable(vivid_context* context, Uint8 enable) {
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (!enable) {
+        free(context->_profiler);
+        context->_profiler = NULL;
+        return VIVID_OK;
+    }
+
+    if (context->_profiler)
+        return VIVID_OK;
+
+    context->_profiler = (_vivid_profiler*) calloc(1, 
+        sizeof(_vivid_profiler));
+    if (!context->_profiler)
+        return VIVID_FAIL;
+
+    return VIVID_OK;
+}
+
+/*
+ * Summarise the last `frames` rendered frames (or all that were kept, if
+ * fewer) into the minimum, average and 99th percentile of every statistic.
+ * Fails if profiling isn't enabled or no frame has been rendered yet.
+ */
+Uint8 vivid_profile_query(vivid_context* context, Uint16 frames, 
+        vivid_profile_summary* summary) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    const _vivid_profiler* prof = context->_profiler;
+    if (!prof || !prof->count)
+        return VIVID_FAIL;
+
+    const Uint32 n = frames && frames < prof->count ? frames : prof->count;
+    *summary = (vivid_profile_summary) { .frames = n };
+
+    // Every statistic is a Uint64, so walk them as an array
+    const int fields = sizeof(vivid_frame_stats) / sizeof(Uint64);
+    Uint64 values[VIVID_PROFILE_FRAMES];
+
+    for (int f = 0; f < fields; f++) {
+        Uint64 sum = 0, min = 0;
+
+        for (Uint32 i = 0; i < n; i++) {
+            const Uint32 slot = (prof->head + VIVID_PROFILE_FRAMES - 1 - i) %
+                VIVID_PROFILE_FRAMES;
+            values[i] = ((const Uint64*) &prof->frames[slot])[f];
+
+            sum += values[i];
+            if (i == 0 || values[i] < min)
+                min = values[i];
+        }
+
+        ((Uint64*) &summary->min)[f] = min;
+        ((Uint64*) &summary->avg)[f] = sum / n;
+        ((Uint64*) &summary->p99)[f] = _vivid_profile_p99(values, n);
+    }
+
+    return VIVID_OK;
+}
+
+/*
+ * Draw a bar graph of the kept frames into the rect `p`, newest on the right
+ * and one pixel column per frame. Each bar stacks draw (green), clear (blue),
+ * upload (yellow) and present (magenta) time, with the rest of the frame in
+ * grey. The red line marks 16.6ms, which is half the height of the graph. 
+ * Call before `vivid_render`, the overlay itself isn't counted.
+ */
+Uint8 vivid_profile_overlay(vivid_context* context, vivid_rect p) {
+    VIVID_ASSERT_CONTEXT(context);
+
+    _vivid_profiler* prof = context->_profiler;
+    if (!prof)
+        return VIVID_FAIL;
+
+    prof->paused = 1;
+
+    const vivid_colour background = { .hex = 0xB0000000 };
+    const vivid_colour rest = VIVID_BRIGHT_BLACK;
+    const vivid_colour parts[4] = { 
+        VIVID_GREEN, VIVID_BLUE, VIVID_YELLOW, VIVID_MAGENTA 
+    };
+
+    vivid_draw_rect(context, p, background);
+
+    // The graph covers 0 to 33.3ms
+    const double scale = p.h / 33333333.0;
+    const Uint32 n = p.w < prof->count ? p.w : prof->count;
+
+    for (Uint32 i = 0; i < n; i++) {
+        const Uint32 slot = (prof->head + VIVID_PROFILE_FRAMES - 1 - i) %
+            VIVID_PROFILE_FRAMES;
+        const vivid_frame_stats* f = &prof->frames[slot];
+        const Uint64 times[4] = { 
+            f->draw_ns, f->clear_ns, f->upload_ns, f->present_ns 
+        };
+
+        const int x = p.x + p.w - 1 - (int) i;
+        int bottom = p.y + p.h;
+
+        for (int t = 0; t < 4; t++) {
+            int height = (int) (times[t] * scale);
+            if (height > bottom - p.y) height = bottom - p.y;
+
+            vivid_draw_rect(context, VIVID_RECT1(x, bottom - height, 1, 
+                height), parts[t]);
+            bottom -= height;
+        }
+
+        int total = (int) (f->frame_ns * scale);
+        if (total > p.h) total = p.h;
+
+        const int top = p.y + p.h - total;
+        if (top < bottom)
+            vivid_draw_rect(context, VIVID_RECT1(x, top, 1, bottom - top), 
+                rest);
+    }
+
+    vivid_draw_rect(context, VIVID_RECT1(p.x, p.y + p.h / 2, p.w, 1), 
+        VIVID_RED);
+
+    prof->paused = 0;
+    return VIVID_OK;
+}
+
+/*
+ * Nanoseconds elapsed since the performance counter value `start`.
+ */
+Uint64 _vivid_profile_ns(Uint64 start) {
+    const Uint64 ticks = SDL_GetPerformanceCounter() - start;
+    return (Uint64) ((double) ticks * 1e9 / 
+        (double) SDL_GetPerformanceFrequency());
+}
+
+/*
+ * The 99th percentile of the `n` values, which are sorted in place.
+ */
+Uint64 _vivid_profile_p99(Uint64* values, Uint32 n) {
+    for (Uint32 i = 1; i < n; i++) {
+        const Uint64 v = values[i];
+        Uint32 j = i;
+        for (; j > 0 && values[j - 1] > v; j--)
+            values[j] = values[j - 1];
+        values[j] = v;
+    }
+
+    return values[(n * 99 + 99) / 100 - 1];
+}
+
+/*
+ * Prepare the `w` by `h` colour buffer `buf` for fast repeated blitting with
+ * `vivid_draw_prepared_sprite`. Each row is split into runs of opaque and 
+ * translucent pixels, fully transparent pixels are skipped entirely and the
+ * pixels are stored premultiplied. The buffer isn't needed after this call.
+ */
+vivid_sprite vivid_sprite_create(vivid_colour* buf, Uint16 w, Uint16 h) {
+    return _vivid_sprite_prepare(buf, w, h, 0, VIVID_BLACK);
+}
+
+/*
+ * Prepare a sprite like `vivid_sprite_create`, but also treat every pixel 
+ * matching the colour `key` (including alpha) as transparent.
+ */
+vivid_sprite vivid_sprite_create_keyed(vivid_colour* buf, Uint16 w, Uint16 h, 
+        vivid_colour key) {
+
+    return _vivid_sprite_prepare(buf, w, h, 1, key);
+}
+
+/*
+ * Free the pixel and run data owned by a prepared sprite.
+ */
+Uint8 vivid_sprite_clean(vivid_sprite* sprite) {
+    free(sprite->pixels);
+    free(sprite->runs);
+    free(sprite->row_runs);
+    *sprite = (vivid_sprite) { 0 };
+
+    return VIVID_OK;
+}
+
+/*
+ * Blit a prepared sprite with its top left corner at point `p` (x, y). The 
+ * sprite is clipped to the window buffer once, opaque runs are copied and
+ * translucent runs are blended with premultiplied alpha. In deferred mode the
+ * sprite must stay valid until the next `vivid_flush` or `vivid_render`.
+ */
+Uint8 vivid_draw_prepared_sprite(vivid_context* context, vivid_rect p, 
+        const vivid_sprite* sprite) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    // Sprite colours have no palette index
+    if (context->_indices)
+        return VIVID_FAIL;
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_PREPARED,
+        .bounds = _vivid_clip_rect(context, 
+            VIVID_RECT1(p.x, p.y, sprite->w, sprite->h)),
+        .prepared = { p.x, p.y, sprite }
+    });
+}
+
+/*
+ * Blit the part of the prepared sprite at (px, py) inside the box `b`, which
+ * has to lie within the sprite.
+ */
+void _vivid_raster_prepared(vivid_context* context, 
+        const vivid_sprite* sprite, int px, int py, _vivid_box b) {
+
+    const int stride = context->window_size.w;
+
+    for (int y = b.y0; y < b.y1; y++) {
+        const int sy = y - py;
+        vivid_colour* row = context->window_buffer + y * stride;
+        const vivid_colour* src = sprite->pixels + sy * sprite->w;
+
+        for (Uint32 r = sprite->row_runs[sy]; 
+                r < sprite->row_runs[sy + 1]; r++) {
+
+            const _vivid_sprite_run run = sprite->runs[r];
+
+            // Clip the run against the visible columns
+            int x0 = px + run.x;
+            int x1 = x0 + run.w;
+            if (x0 < b.x0) x0 = b.x0;
+            if (x1 > b.x1) x1 = b.x1;
+            if (x0 >= x1) continue;
+
+            const vivid_colour* s = src + (x0 - px);
+            if (run.opaque)
+                memcpy(row + x0, s, sizeof(vivid_colour) * (x1 - x0));
+            else
+                _vivid_blend_row_pm(row + x0, s, x1 - x0);
+        }
+    }
+}
+
+/*
+ * Classify every pixel of `buf` and build the run list of a prepared sprite.
+ * When `keyed` is set, pixels equal to `key` are treated as transparent.
+ */
+vivid_sprite _vivid_sprite_prepare(vivid_colour* buf, Uint16 w, Uint16 h, 
+        Uint8 keyed, vivid_colour key) {
+
+    vivid_sprite sprite = (vivid_sprite) { .w = w, .h = h };
+    sprite.pixels = (vivid_colour*) malloc(sizeof(vivid_colour) * w * h);
+    sprite.row_runs = (Uint32*) malloc(sizeof(Uint32) * (h + 1));
+
+    // Worst case is alternating visible and transparent pixels
+    sprite.runs = (_vivid_sprite_run*) malloc(sizeof(_vivid_sprite_run) * 
+        h * ((w + 1) / 2 + 1));
+
+    if (!sprite.pixels || !sprite.row_runs || !sprite.runs)
+        VIVID_PANIC("VIVID couldn't allocate sprite", VIVID_FAIL);
+
+    Uint32 count = 0;
+    for (int y = 0; y < h; y++) {
+        const vivid_colour* src = buf + y * w;
+        vivid_colour* dst = sprite.pixels + y * w;
+        sprite.row_runs[y] = count;
+
+        // Premultiply so the blit only needs the destination weight
+        for (int x = 0; x < w; x++) {
+            vivid_colour pm = src[x];
+            if (pm.a == 0 || (keyed && pm.hex == key.hex)) {
+                dst[x].hex = 0;
+                continue;
+            }
+
+            pm.r = (pm.r * pm.a + 127) / 255;
+            pm.g = (pm.g * pm.a + 127) / 255;
+            pm.b = (pm.b * pm.a + 127) / 255;
+            dst[x] = pm;
+        }
+
+        int x = 0;
+        while (x < w) {
+            if (dst[x].a == 0) {
+                x++;
+                continue;
+            }
+
+            // Transparent premultiplied pixels blend to the destination 
+            // unchanged, so short gaps are cheaper to blend than to skip
+            int end = x, gap = 0;
+            for (int i = x; i < w && gap < VIVID_SPRITE_GAP; i++) {
+                if (dst[i].a == 0) {
+                    gap++;
+                } else {
+                    gap = 0;
+                    end = i + 1;
+                }
+            }
+
+            // Long opaque stretches inside the segment are copied instead
+            int start = x;
+            while (x < end) {
+                int o = x;
+                while (o < end && dst[o].a == 255) o++;
+
+                if (o - x >= VIVID_SPRITE_COPY || (x == start && o == end)) {
+                    if (x > start)
+                        sprite.runs[count++] = (_vivid_sprite_run) {
+                            .x = start, .w = x - start, .opaque = 0 };
+                    sprite.runs[count++] = (_vivid_sprite_run) {
+                        .x = x, .w = o - x, .opaque = 1 };
+                    start = o;
+                }
+                x = o;
+
+                while (x < end && dst[x].a != 255) x++;
+            }
+
+            if (end > start)
+                sprite.runs[count++] = (_vivid_sprite_run) {
+                    .x = start, .w = end - start, .opaque = 0 };
+        }
+    }
+    sprite.row_runs[h] = count;
+
+    return sprite;
+}
+
+/* Public domain 8x8 console font by Daniel Hepper (font8x8_basic), one byte
+ * per row with the lowest bit leftmost, characters 32 to 126 */
+const Uint8 _vivid_font_8x8[95][8] = {
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // (space)
+    { 0x18, 0x3C, 0x3C, 0x18, 0x18, 0x00, 0x18, 0x00 }, // !
+    { 0x36, 0x36, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // "
+    { 0x36, 0x36, 0x7F, 0x36, 0x7F, 0x36, 0x36, 0x00 }, // #
+    { 0x0C, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x0C, 0x00 }, // $
+    { 0x00, 0x63, 0x33, 0x18, 0x0C, 0x66, 0x63, 0x00 }, // %
+    { 0x1C, 0x36, 0x1C, 0x6E, 0x3B, 0x33, 0x6E, 0x00 }, // &
+    { 0x06, 0x06, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00 }, // '
+    { 0x18, 0x0C, 0x06, 0x06, 0x06, 0x0C, 0x18, 0x00 }, // (
+    { 0x06, 0x0C, 0x18, 0x18, 0x18, 0x0C, 0x06, 0x00 }, // )
+    { 0x00, 0x66, 0x3C, 0xFF, 0x3C, 0x66, 0x00, 0x00 }, // *
+    { 0x00, 0x0C, 0x0C, 0x3F, 0x0C, 0x0C, 0x00, 0x00 }, // +
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ,
+    { 0x00, 0x00, 0x00, 0x3F, 0x00, 0x00, 0x00, 0x00 }, // -
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // .
+    { 0x60, 0x30, 0x18, 0x0C, 0x06, 0x03, 0x01, 0x00 }, // /
+    { 0x3E, 0x63, 0x73, 0x7B, 0x6F, 0x67, 0x3E, 0x00 }, // 0
+    { 0x0C, 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x3F, 0x00 }, // 1
+    { 0x1E, 0x33, 0x30, 0x1C, 0x06, 0x33, 0x3F, 0x00 }, // 2
+    { 0x1E, 0x33, 0x30, 0x1C, 0x30, 0x33, 0x1E, 0x00 }, // 3
+    { 0x38, 0x3C, 0x36, 0x33, 0x7F, 0x30, 0x78, 0x00 }, // 4
+    { 0x3F, 0x03, 0x1F, 0x30, 0x30, 0x33, 0x1E, 0x00 }, // 5
+    { 0x1C, 0x06, 0x03, 0x1F, 0x33, 0x33, 0x1E, 0x00 }, // 6
+    { 0x3F, 0x33, 0x30, 0x18, 0x0C, 0x0C, 0x0C, 0x00 }, // 7
+    { 0x1E, 0x33, 0x33, 0x1E, 0x33, 0x33, 0x1E, 0x00 }, // 8
+    { 0x1E, 0x33, 0x33, 0x3E, 0x30, 0x18, 0x0E, 0x00 }, // 9
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x00 }, // :
+    { 0x00, 0x0C, 0x0C, 0x00, 0x00, 0x0C, 0x0C, 0x06 }, // ;
+    { 0x18, 0x0C, 0x06, 0x03, 0x06, 0x0C, 0x18, 0x00 }, // <
+    { 0x00, 0x00, 0x3F, 0x00, 0x00, 0x3F, 0x00, 0x00 }, // =
+    { 0x06, 0x0C, 0x18, 0x30, 0x18, 0x0C, 0x06, 0x00 }, // >
+    { 0x1E, 0x33, 0x30, 0x18, 0x0C, 0x00, 0x0C, 0x00 }, // ?
+    { 0x3E, 0x63, 0x7B, 0x7B, 0x7B, 0x03, 0x1E, 0x00 }, // @
+    { 0x0C, 0x1E, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x00 }, // A
+    { 0x3F, 0x66, 0x66, 0x3E, 0x66, 0x66, 0x3F, 0x00 }, // B
+    { 0x3C, 0x66, 0x03, 0x03, 0x03, 0x66, 0x3C, 0x00 }, // C
+    { 0x1F, 0x36, 0x66, 0x66, 0x66, 0x36, 0x1F, 0x00 }, // D
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x46, 0x7F, 0x00 }, // E
+    { 0x7F, 0x46, 0x16, 0x1E, 0x16, 0x06, 0x0F, 0x00 }, // F
+    { 0x3C, 0x66, 0x03, 0x03, 0x73, 0x66, 0x7C, 0x00 }, // G
+    { 0x33, 0x33, 0x33, 0x3F, 0x33, 0x33, 0x33, 0x00 }, // H
+    { 0x1E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // I
+    { 0x78, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E, 0x00 }, // J
+    { 0x67, 0x66, 0x36, 0x1E, 0x36, 0x66, 0x67, 0x00 }, // K
+    { 0x0F, 0x06, 0x06, 0x06, 0x46, 0x66, 0x7F, 0x00 }, // L
+    { 0x63, 0x77, 0x7F, 0x7F, 0x6B, 0x63, 0x63, 0x00 }, // M
+    { 0x63, 0x67, 0x6F, 0x7B, 0x73, 0x63, 0x63, 0x00 }, // N
+    { 0x1C, 0x36, 0x63, 0x63, 0x63, 0x36, 0x1C, 0x00 }, // O
+    { 0x3F, 0x66, 0x66, 0x3E, 0x06, 0x06, 0x0F, 0x00 }, // P
+    { 0x1E, 0x33, 0x33, 0x33, 0x3B, 0x1E, 0x38, 0x00 }, // Q
+    { 0x3F, 0x66, 0x66, 0x3E, 0x36, 0x66, 0x67, 0x00 }, // R
+    { 0x1E, 0x33, 0x07, 0x0E, 0x38, 0x33, 0x1E, 0x00 }, // S
+    { 0x3F, 0x2D, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // T
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x33, 0x3F, 0x00 }, // U
+    { 0x33, 0x33, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // V
+    { 0x63, 0x63, 0x63, 0x6B, 0x7F, 0x77, 0x63, 0x00 }, // W
+    { 0x63, 0x63, 0x36, 0x1C, 0x1C, 0x36, 0x63, 0x00 }, // X
+    { 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x0C, 0x1E, 0x00 }, // Y
+    { 0x7F, 0x63, 0x31, 0x18, 0x4C, 0x66, 0x7F, 0x00 }, // Z
+    { 0x1E, 0x06, 0x06, 0x06, 0x06, 0x06, 0x1E, 0x00 }, // [
+    { 0x03, 0x06, 0x0C, 0x18, 0x30, 0x60, 0x40, 0x00 }, // (backslash)
+    { 0x1E, 0x18, 0x18, 0x18, 0x18, 0x18, 0x1E, 0x00 }, // ]
+    { 0x08, 0x1C, 0x36, 0x63, 0x00, 0x00, 0x00, 0x00 }, // ^
+    { 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0xFF }, // _
+    { 0x0C, 0x0C, 0x18, 0x00, 0x00, 0x00, 0x00, 0x00 }, // `
+    { 0x00, 0x00, 0x1E, 0x30, 0x3E, 0x33, 0x6E, 0x00 }, // a
+    { 0x07, 0x06, 0x06, 0x3E, 0x66, 0x66, 0x3B, 0x00 }, // b
+    { 0x00, 0x00, 0x1E, 0x33, 0x03, 0x33, 0x1E, 0x00 }, // c
+    { 0x38, 0x30, 0x30, 0x3E, 0x33, 0x33, 0x6E, 0x00 }, // d
+    { 0x00, 0x00, 0x1E, 0x33, 0x3F, 0x03, 0x1E, 0x00 }, // e
+    { 0x1C, 0x36, 0x06, 0x0F, 0x06, 0x06, 0x0F, 0x00 }, // f
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // g
+    { 0x07, 0x06, 0x36, 0x6E, 0x66, 0x66, 0x67, 0x00 }, // h
+    { 0x0C, 0x00, 0x0E, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // i
+    { 0x30, 0x00, 0x30, 0x30, 0x30, 0x33, 0x33, 0x1E }, // j
+    { 0x07, 0x06, 0x66, 0x36, 0x1E, 0x36, 0x67, 0x00 }, // k
+    { 0x0E, 0x0C, 0x0C, 0x0C, 0x0C, 0x0C, 0x1E, 0x00 }, // l
+    { 0x00, 0x00, 0x33, 0x7F, 0x7F, 0x6B, 0x63, 0x00 }, // m
+    { 0x00, 0x00, 0x1F, 0x33, 0x33, 0x33, 0x33, 0x00 }, // n
+    { 0x00, 0x00, 0x1E, 0x33, 0x33, 0x33, 0x1E, 0x00 }, // o
+    { 0x00, 0x00, 0x3B, 0x66, 0x66, 0x3E, 0x06, 0x0F }, // p
+    { 0x00, 0x00, 0x6E, 0x33, 0x33, 0x3E, 0x30, 0x78 }, // q
+    { 0x00, 0x00, 0x3B, 0x6E, 0x66, 0x06, 0x0F, 0x00 }, // r
+    { 0x00, 0x00, 0x3E, 0x03, 0x1E, 0x30, 0x1F, 0x00 }, // s
+    { 0x08, 0x0C, 0x3E, 0x0C, 0x0C, 0x2C, 0x18, 0x00 }, // t
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x33, 0x6E, 0x00 }, // u
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x1E, 0x0C, 0x00 }, // v
+    { 0x00, 0x00, 0x63, 0x6B, 0x7F, 0x7F, 0x36, 0x00 }, // w
+    { 0x00, 0x00, 0x63, 0x36, 0x1C, 0x36, 0x63, 0x00 }, // x
+    { 0x00, 0x00, 0x33, 0x33, 0x33, 0x3E, 0x30, 0x1F }, // y
+    { 0x00, 0x00, 0x3F, 0x19, 0x0C, 0x26, 0x3F, 0x00 }, // z
+    { 0x38, 0x0C, 0x0C, 0x07, 0x0C, 0x0C, 0x38, 0x00 }, // {
+    { 0x18, 0x18, 0x18, 0x00, 0x18, 0x18, 0x18, 0x00 }, // |
+    { 0x07, 0x0C, 0x0C, 0x38, 0x0C, 0x0C, 0x07, 0x00 }, // }
+    { 0x6E, 0x3B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00 }, // ~
+};
+
+/*
+ * Build a font from 8-bit coverage masks, `count` glyphs of `w` by `h` bytes
+ * for the characters from `first` on. Each glyph is trimmed to the box that
+ * has any coverage and its metrics are cached, so drawing text only visits
+ * ink. The masks aren't needed after this call.
+ */
+vivid_font vivid_font_create(const Uint8* coverage, Uint8 w, Uint8 h, 
+        Uint8 first, Uint16 count) {
+
+    if (count > 256 - first)
+        count = 256 - first;
+
+    vivid_font font = (vivid_font) { 
+        .w = w, .h = h, .first = first, .count = count 
+    };
+    font.glyphs = (_vivid_glyph*) malloc(sizeof(_vivid_glyph) * count);
+    font.coverage = (Uint8*) malloc((size_t) w * h * count + 1);
+
+    if (!font.glyphs || !font.coverage)
+        VIVID_PANIC("VIVID couldn't allocate font", VIVID_FAIL);
+
+    Uint32 offset = 0;
+    for (int i = 0; i < count; i++) {
+        const Uint8* src = coverage + (size_t) i * w * h;
+
+        int x0 = w, y0 = h, x1 = 0, y1 = 0;
+        for (int y = 0; y < h; y++) {
+            for (int x = 0; x < w; x++) {
+                if (!src[y * w + x])
+                    continue;
+                if (x < x0) x0 = x;
+                if (y < y0) y0 = y;
+                if (x >= x1) x1 = x + 1;
+                if (y >= y1) y1 = y + 1;
+            }
+        }
+
+        if (x0 >= x1) {
+            font.glyphs[i] = (_vivid_glyph) { 0 };
+            continue;
+        }
+
+        font.glyphs[i] = (_vivid_glyph) { 
+            x0, y0, x1 - x0, y1 - y0, offset 
+        };
+        for (int y = y0; y < y1; y++) {
+            memcpy(font.coverage + offset, src + y * w + x0, x1 - x0);
+            offset += x1 - x0;
+        }
+    }
+
+    return font;
+}
+
+/*
+ * Build a font from 1-bit glyphs, every row `(w + 7) / 8` bytes with the
+ * lowest bit leftmost, the layout of most public domain console fonts.
+ */
+vivid_font vivid_font_create_bitmap(const Uint8* bits, Uint8 w, Uint8 h, 
+        Uint8 first, Uint16 count) {
+
+    if (count > 256 - first)
+        count = 256 - first;
+
+    const int pitch = (w + 7) / 8;
+    Uint8* coverage = (Uint8*) malloc((size_t) w * h * count + 1);
+    if (!coverage)
+        VIVID_PANIC("VIVID couldn't allocate font", VIVID_FAIL);
+
+    Uint8* dst = coverage;
+    for (int i = 0; i < count * h; i++, bits += pitch) {
+        for (int x = 0; x < w; x++)
+            *dst++ = (bits[x / 8] >> (x % 8)) & 1 ? 255 : 0;
+    }
+
+    vivid_font font = vivid_font_create(coverage, w, h, first, count);
+    free(coverage);
+
+    return font;
+}
+
+/*
+ * Build the built in 8x8 font covering printable ASCII.
+ */
+vivid_font vivid_font_create_default(void) {
+    return vivid_font_create_bitmap(&_vivid_font_8x8[0][0], 8, 8, 32, 95);
+}
+
+/*
+ * Free the glyph atlas and metrics owned by a font.
+ */
+Uint8 vivid_font_clean(vivid_font* font) {
+    free(font->glyphs);
+    free(font->coverage);
+    *font = (vivid_font) { 0 };
+
+    return VIVID_OK;
+}
+
+/*
+ * Width in pixels of `text` drawn with `font`.
+ */
+Uint32 vivid_text_width(const vivid_font* font, const char* text) {
+    return (Uint32) strlen(text) * font->w;
+}
+
+/*
+ * Render the string `text` with its top left corner at point `p` (x, y) in
+ * colour `c`, using the glyph coverage of `font` as alpha. The string is 
+ * clipped to the window once and only the visible characters are kept, 
+ * characters the font doesn't have are left blank. In deferred mode the 
+ * visible characters are copied, but `font` must stay valid until the next
+ * `vivid_flush` or `vivid_render`.
+ */
+Uint8 vivid_draw_text(vivid_context* context, vivid_rect p, const char* text,
+        const vivid_font* font, vivid_colour c) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (c.a == 0 || !font->w)
+        return VIVID_OK;
+
+    const _vivid_box window = (_vivid_box) { 
+        0, 0, context->window_size.w, context->window_size.h 
+    };
+    const Sint64 length = (Sint64) strlen(text);
+    const _vivid_box b = _vivid_box_clip(window, (_vivid_box) {
+        p.x, p.y, 
+        (int) (p.x + (length * font->w < 65536 ? length * font->w : 65536)), 
+        p.y + font->h
+    });
+    if (b.x0 >= b.x1 || b.y0 >= b.y1)
+        return VIVID_OK;
+
+    // Characters overlapping the visible columns
+    const int first = (b.x0 - p.x) / font->w;
+    const int last = (b.x1 - 1 - p.x) / font->w;
+
+    const char* visible = text + first;
+    if (context->_deferred)
+        visible = _vivid_arena_copy(&context->_deferred->arena, visible, 
+            last - first + 1);
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_TEXT,
+        .colour = c,
+        .bounds = b,
+        .text = { 
+            p.x + first * font->w, p.y, last - first + 1, visible, font 
+        }
+    });
+}
+
+/*
+ * Rasterise the glyphs of a text command inside the box `b`, each clipped 
+ * ink box is blended one row of coverage at a time.
+ */
+void _vivid_raster_text(vivid_context* context, 
+        const _vivid_command* command, _vivid_box b) {
+
+    const vivid_font* font = command->text.font;
+    const int stride = context->window_size.w;
+    const int tx = command->text.x, ty = command->text.y;
+
+    int first = (b.x0 - tx) / font->w;
+    int last = (b.x1 - 1 - tx) / font->w;
+    if (last >= (int) command->text.length)
+        last = command->text.length - 1;
+
+    for (int i = first; i <= last; i++) {
+        const int ch = (Uint8) command->text.text[i] - font->first;
+        if (ch < 0 || ch >= font->count)
+            continue;
+
+        const _vivid_glyph g = font->glyphs[ch];
+        const int gx = tx + i * font->w + g.x, gy = ty + g.y;
+
+        const int x0 = gx > b.x0 ? gx : b.x0;
+        const int y0 = gy > b.y0 ? gy : b.y0;
+        const int x1 = gx + g.w < b.x1 ? gx + g.w : b.x1;
+        const int y1 = gy + g.h < b.y1 ? gy + g.h : b.y1;
+        if (x0 >= x1 || y0 >= y1)
+            continue;
+
+        const Uint8* mask = font->coverage + g.offset + (y0 - gy) * g.w + 
+            (x0 - gx);
+
+        if (context->_indices) {
+            Uint8* row = context->_indices + y0 * stride + x0;
+            for (int y = y0; y < y1; y++, row += stride, mask += g.w)
+                _vivid_index_mask_row(row, mask, x1 - x0, 
+                    command->colour.r);
+            continue;
+        }
+
+        vivid_colour* row = context->window_buffer + y0 * stride + x0;
+        for (int y = y0; y < y1; y++, row += stride, mask += g.w)
+            _vivid_blend_mask_row(row, mask, x1 - x0, command->colour);
+    }
+}
+
+/*
+ * Blend `n` pixels of colour `c` into `dst`, scaling its alpha by the 
+ * coverage `mask`. Uncovered pixels are skipped and fully covered pixels of
+ * an opaque colour are stored directly.
+ */
+void _vivid_blend_mask_row(vivid_colour* dst, const Uint8* mask, int n, 
+        vivid_colour c) {
+
+    for (int i = 0; i < n; i++) {
+        const Uint32 m = mask[i];
+        if (m == 0)
+            continue;
+
+        if ((m & c.a) == 255) {
+            dst[i] = c;
+            continue;
+        }
+
+        // Rounded m * a / 255
+        const Uint32 a = m * c.a + 128;
+        vivid_colour s = c;
+        s.a = (Uint8) ((a + (a >> 8)) >> 8);
+        dst[i].hex = _vivid_blend_pixel(dst[i].hex, s.hex);
+    }
+}
+
+/*
+ * Switch the context between drawing immediately on the calling thread and
+ * deferred rendering with `threads` threads (including the caller), or one 
+ * per CPU for `VIVID_THREADS_AUTO`. Deferred draw calls are only recorded, 
+ * then on `vivid_flush` or `vivid_render` the commands are binned into tiles
+ * of `VIVID_TILE_SIZE` and the tiles rasterised in parallel. Each tile replays
+ * its commands in submission order, so the result matches immediate mode.
+ * Passing zero threads returns to immediate mode.
+ */
+Uint8 vivid_set_deferred(vivid_context* context, Uint8 threads) {
+    VIVID_ASSERT_CONTEXT(context);
+
+    // Anything recorded under the previous mode is drawn first
+    vivid_flush(context);
+    _vivid_deferred_destroy(context);
+
+    if (threads == 0)
+        return VIVID_OK;
+    if (threads == VIVID_THREADS_AUTO)
+        threads = SDL_GetCPUCount() < 254 ? SDL_GetCPUCount() : 254;
+
+    _vivid_deferred* d = (_vivid_deferred*) calloc(1, sizeof(_vivid_deferred));
+    if (!d)
+        VIVID_PANIC("VIVID couldn't allocate deferred state", VIVID_FAIL);
+
+    d->tiles_x = (context->window_size.w + VIVID_TILE_SIZE - 1) / 
+        VIVID_TILE_SIZE;
+    d->tiles_y = (context->window_size.h + VIVID_TILE_SIZE - 1) / 
+        VIVID_TILE_SIZE;
+
+    const int tiles = d->tiles_x * d->tiles_y;
+    d->tile_start = (Uint32*) malloc(sizeof(Uint32) * (tiles + 1));
+    d->tile_cursor = (Uint32*) malloc(sizeof(Uint32) * tiles);
+    d->workers = (_vivid_worker*) calloc(threads, sizeof(_vivid_worker));
+    d->done = SDL_CreateSemaphore(0);
+
+    if (!d->tile_start || !d->tile_cursor || !d->workers || !d->done)
+        VIVID_PANIC("VIVID couldn't allocate deferred state", VIVID_FAIL);
+
+    context->_deferred = d;
+    d->threads = 1;
+    d->workers[0].deferred = d;
+
+    // Fewer workers is still correct, so stop at the first one SDL refuses
+    for (int i = 1; i < threads; i++) {
+        _vivid_worker* w = &d->workers[i];
+        w->deferred = d;
+        w->start = SDL_CreateSemaphore(0);
+        if (!w->start)
+            break;
+
+        w->thread = SDL_CreateThread(_vivid_worker_main, "vivid_worker", w);
+        if (!w->thread) {
+            SDL_DestroySemaphore(w->start);
+            break;
+        }
+        d->threads++;
+    }
+
+    return VIVID_OK;
+}
+
+/*
+ * Rasterise every command recorded in deferred mode into the window buffer.
+ * Called by `vivid_render`, but can be used to read the buffer mid frame. 
+ * Does nothing when drawing immediately.
+ */
+Uint8 vivid_flush(vivid_context* context) {
+    VIVID_ASSERT_CONTEXT(context);
+
+    _vivid_deferred* d = context->_deferred;
+    if (!d || !d->command_count)
+        return VIVID_OK;
+
+    const Uint64 start = context->_profiler ? 
+        SDL_GetPerformanceCounter() : 0;
+
+    d->context = context;
+    _vivid_deferred_bin(d);
+
+    // Split the tiles into one contiguous range per worker
+    const int tiles = d->tiles_x * d->tiles_y;
+    for (int i = 0; i < d->threads; i++) {
+        SDL_AtomicSet(&d->workers[i].next, i * tiles / d->threads);
+        d->workers[i].end = (i + 1) * tiles / d->threads;
+    }
+
+    for (int i = 1; i < d->threads; i++)
+        SDL_SemPost(d->workers[i].start);
+
+    _vivid_worker_run(&d->workers[0]);
+
+    for (int i = 1; i < d->threads; i++)
+        SDL_SemWait(d->done);
+
+    if (context->_profiler && !context->_profiler->paused)
+        context->_profiler->current.draw_ns += _vivid_profile_ns(start);
+
+    d->command_count = 0;
+    _vivid_arena_reset(&d->arena);
+    return VIVID_OK;
+}
+
+/*
+ * Track the region a draw command touches and either rasterise it straight
+ * away or record it for the deferred workers.
+ */
+Uint8 _vivid_submit(vivid_context* context, const _vivid_command* command) {
+    const _vivid_box b = command->bounds;
+    if (b.x0 >= b.x1 || b.y0 >= b.y1)
+        return VIVID_OK;
+
+    _vivid_profiler* prof = context->_profiler;
+    if (prof && prof->paused)
+        prof = NULL;
+
+    const Uint64 start = prof ? SDL_GetPerformanceCounter() : 0;
+
+    _vivid_tiles_touch(context, b);
+    _vivid_dirty_add(context, b);
+
+    _vivid_deferred* d = context->_deferred;
+    if (!d) {
+        _vivid_command_run(context, command, b);
+    } else {
+        if (d->command_count == d->command_capacity) {
+            const Uint32 capacity = d->command_capacity ? 
+                d->command_capacity * 2 : 256;
+            _vivid_command* commands = (_vivid_command*) realloc(
+                d->commands, sizeof(_vivid_command) * capacity);
+            if (!commands)
+                VIVID_PANIC("VIVID couldn't grow the command list", 
+                    VIVID_FAIL);
+
+            d->commands = commands;
+            d->command_capacity = capacity;
+        }
+
+        d->commands[d->command_count++] = *command;
+    }
+
+    if (prof) {
+        prof->current.draw_ns += _vivid_profile_ns(start);
+        prof->current.primitives++;
+
+        // Lines only touch one pixel per step of their longest axis, two
+        // when anti-aliased
+        if (command->type == VIVID_COMMAND_LINE) {
+            const int w = b.x1 - b.x0, h = b.y1 - b.y0;
+            prof->current.pixels += w > h ? w : h;
+        } else if (command->type == VIVID_COMMAND_LINE_AA) {
+            const int w = b.x1 - b.x0, h = b.y1 - b.y0;
+            prof->current.pixels += 2 * (w > h ? w : h);
+        } else if (command->type == VIVID_COMMAND_TRIANGLE) {
+            // Triangles cover about half their box, ellipses about pi / 4
+            prof->current.pixels += (Uint64) (b.x1 - b.x0) * (b.y1 - b.y0) / 2;
+        } else if (command->type == VIVID_COMMAND_ELLIPSE) {
+            prof->current.pixels += 
+                (Uint64) (b.x1 - b.x0) * (b.y1 - b.y0) * 201 / 256;
+        } else if (command->type == VIVID_COMMAND_POINTS) {
+            // Batches count each element once per band or tile it covers
+            prof->current.primitives += command->batch.count - 1;
+            prof->current.pixels += command->batch.count;
+        } else if (command->type == VIVID_COMMAND_RECTS || 
+                command->type == VIVID_COMMAND_SPRITES) {
+            const vivid_sprite* sprite = command->batch.sprite;
+            prof->current.primitives += command->batch.count - 1;
+
+            for (Uint32 i = 0; i < command->batch.count; i++) {
+                const vivid_rect p = command->batch.items[i].p;
+                const _vivid_box r = _vivid_box_clip(b, (_vivid_box) { 
+                    p.x, p.y, 
+                    p.x + (sprite ? sprite->w : p.w), 
+                    p.y + (sprite ? sprite->h : p.h) 
+                });
+                prof->current.pixels += (Uint64) (r.x1 - r.x0) * 
+                    (r.y1 - r.y0);
+            }
+        } else {
+            prof->current.pixels += (Uint64) (b.x1 - b.x0) * (b.y1 - b.y0);
+        }
+    }
+
+    return VIVID_OK;
+}
+
+/*
+ * Rasterise a single command, touching only the pixels inside `clip`. The 
+ * pixels written inside `clip` are the same no matter how the rest of the
+ * window is split, which keeps the tiled output identical to immediate mode.
+ */
+void _vivid_command_run(vivid_context* context, const _vivid_command* command,
+        _vivid_box clip) {
+
+    const _vivid_box b = _vivid_box_clip(command->bounds, clip);
+    if (b.x0 >= b.x1 || b.y0 >= b.y1)
+        return;
+
+    const int stride = context->window_size.w;
+    const vivid_colour c = command->colour;
+
+    switch (command->type) {
+    case VIVID_COMMAND_PIXEL: {
+        if (context->_indices) {
+            context->_indices[b.y0 * stride + b.x0] = c.r;
+            break;
+        }
+
+        vivid_colour* px = context->window_buffer + b.y0 * stride + b.x0;
+        px->hex = _vivid_blend_pixel(px->hex, c.hex);
+        break;
+    }
+
+    case VIVID_COMMAND_RECT:
+        for (int y = b.y0; y < b.y1; y++)
+            _vivid_span(context, b.x0, y, b.x1 - b.x0, c);
+        break;
+
+    case VIVID_COMMAND_LINE:
+        _vivid_raster_line(context, command, b);
+        break;
+
+    // Indices can't be blended, so indexed contexts draw the plain line
+    case VIVID_COMMAND_LINE_AA:
+        if (context->_indices)
+            _vivid_raster_line(context, command, b);
+        else
+            _vivid_raster_line_aa(context, command, b);
+        break;
+
+    case VIVID_COMMAND_AFFINE:
+        _vivid_raster_affine(context, command, b);
+        break;
+
+    case VIVID_COMMAND_TRIANGLE:
+        _vivid_raster_triangle(context, command, b);
+        break;
+
+    case VIVID_COMMAND_ELLIPSE:
+        _vivid_raster_ellipse(context, command, b);
+        break;
+
+    case VIVID_COMMAND_TEXT:
+        _vivid_raster_text(context, command, b);
+        break;
+
+    case VIVID_COMMAND_SPRITE: {
+        const int sw = command->sprite.w;
+        const int n = b.x1 - b.x0;
+        vivid_colour* row = context->window_buffer + b.y0 * stride + b.x0;
+        const vivid_colour* src = command->sprite.pixels + 
+            (b.y0 - command->sprite.y) * sw + (b.x0 - command->sprite.x);
+
+        for (int y = b.y0; y < b.y1; y++, row += stride, src += sw)
+            _vivid_blend_row(row, src, n);
+        break;
+    }
+
+    case VIVID_COMMAND_PREPARED:
+        _vivid_raster_prepared(context, command->prepared.sprite, 
+            command->prepared.x, command->prepared.y, b);
+        break;
+
+    case VIVID_COMMAND_POINTS:
+    case VIVID_COMMAND_RECTS:
+    case VIVID_COMMAND_SPRITES:
+        _vivid_raster_batch(context, command, b);
+        break;
+    }
+}
+
+/*
+ * Stop the worker threads and free the deferred state of the context, any
+ * commands still recorded are dropped.
+ */
+void _vivid_deferred_destroy(vivid_context* context) {
+    _vivid_deferred* d = context->_deferred;
+    if (!d)
+        return;
+
+    SDL_AtomicSet(&d->quit, 1);
+    for (int i = 1; i < d->threads; i++) {
+        SDL_SemPost(d->workers[i].start);
+        SDL_WaitThread(d->workers[i].thread, NULL);
+        SDL_DestroySemaphore(d->workers[i].start);
+    }
+
+    SDL_DestroySemaphore(d->done);
+    free(d->workers);
+    free(d->commands);
+    _vivid_arena_free(&d->arena);
+    free(d->tile_start);
+    free(d->tile_cursor);
+    free(d->tile_commands);
+    free(d);
+
+    context->_deferred = NULL;
+}
+
+/*
+ * Reserve `n` bytes of the arena, 8 byte aligned, starting a new block twice
+ * the size of the last when it is full. Returns a pointer that stays valid 
+ * until the arena is reset.
+ */
+char* _vivid_arena_alloc(_vivid_arena** arena, size_t n) {
+    _vivid_arena* a = *arena;
+    size_t used = a ? (a->used + 7) & ~(size_t) 7 : 0;
+
+    if (!a || used > a->size || a->size - used < n) {
+        size_t size = a ? a->size * 2 : 4096;
+        if (size < n)
+            size = n;
+
+        _vivid_arena* block = (_vivid_arena*) malloc(
+            sizeof(_vivid_arena) + size);
+        if (!block)
+            VIVID_PANIC("VIVID couldn't grow the frame arena", VIVID_FAIL);
+
+        *block = (_vivid_arena) { .next = a, .size = size };
+        *arena = a = block;
+        used = 0;
+    }
+
+    char* dst = a->data + used;
+    a->used = used + n;
+
+    return dst;
+}
+
+/*
+ * Copy `n` bytes of `src` into the arena, see `_vivid_arena_alloc`.
+ */
+char* _vivid_arena_copy(_vivid_arena** arena, const char* src, size_t n) {
+    return (char*) memcpy(_vivid_arena_alloc(arena, n), src, n);
+}
+
+/*
+ * Empty the arena. When the last frame needed more than one block they are
+ * replaced by a single block as large as all of them, so a steady frame 
+ * doesn't allocate.
+ */
+void _vivid_arena_reset(_vivid_arena** arena) {
+    _vivid_arena* a = *arena;
+    if (!a)
+        return;
+
+    if (a->next) {
+        size_t size = 0;
+        for (_vivid_arena* b = a; b; b = b->next)
+            size += b->size;
+
+        _vivid_arena_free(arena);
+        a = (_vivid_arena*) malloc(sizeof(_vivid_arena) + size);
+        if (!a)
+            VIVID_PANIC("VIVID couldn't grow the frame arena", VIVID_FAIL);
+
+        *a = (_vivid_arena) { .size = size };
+        *arena = a;
+    }
+
+    a->used = 0;
+}
+
+/*
+ * Free every block of the arena.
+ */
+void _vivid_arena_free(_vivid_arena** arena) {
+    _vivid_arena* a = *arena;
+    while (a) {
+        _vivid_arena* next = a->next;
+        free(a);
+        a = next;
+    }
+
+    *arena = NULL;
+}
+
+/*
+ * Bin the recorded commands into every tile their bounds overlap, keeping the
+ * submission order within each tile. Counts first so the index array can be
+ * filled in one pass and reused across frames.
+ */
+void _vivid_deferred_bin(_vivid_deferred* d) {
+    const int tiles = d->tiles_x * d->tiles_y;
+    memset(d->tile_start, 0, sizeof(Uint32) * (tiles + 1));
+
+    for (Uint32 i = 0; i < d->command_count; i++) {
+        const _vivid_box b = d->commands[i].bounds;
+        for (int ty = b.y0 / VIVID_TILE_SIZE; 
+                ty <= (b.y1 - 1) / VIVID_TILE_SIZE; ty++)
+            for (int tx = b.x0 / VIVID_TILE_SIZE; 
+                    tx <= (b.x1 - 1) / VIVID_TILE_SIZE; tx++)
+                d->tile_start[ty * d->tiles_x + tx + 1]++;
+    }
+
+    for (int t = 0; t < tiles; t++) {
+        d->tile_start[t + 1] += d->tile_start[t];
+        d->tile_cursor[t] = d->tile_start[t];
+    }
+
+    const Uint32 total = d->tile_start[tiles];
+    if (total > d->tile_capacity) {
+        Uint32* commands = (Uint32*) realloc(d->tile_commands, 
+            sizeof(Uint32) * total);
+        if (!commands)
+            VIVID_PANIC("VIVID couldn't grow the tile bins", VIVID_FAIL);
+
+        d->tile_commands = commands;
+        d->tile_capacity = total;
+    }
+
+    for (Uint32 i = 0; i < d->command_count; i++) {
+        const _vivid_box b = d->commands[i].bounds;
+        for (int ty = b.y0 / VIVID_TILE_SIZE; 
+                ty <= (b.y1 - 1) / VIVID_TILE_SIZE; ty++)
+            for (int tx = b.x0 / VIVID_TILE_SIZE; 
+                    tx <= (b.x1 - 1) / VIVID_TILE_SIZE; tx++)
+                d->tile_commands[d->tile_cursor[ty * d->tiles_x + tx]++] = i;
+    }
+}
+
+/*
+ * Replay the commands binned to tile `t`, clipped to that tile.
+ */
+void _vivid_tile_run(_vivid_deferred* d, int t) {
+    const int tx = (t % d->tiles_x) * VIVID_TILE_SIZE;
+    const int ty = (t / d->tiles_x) * VIVID_TILE_SIZE;
+    const _vivid_box tile = (_vivid_box) { 
+        tx, ty, tx + VIVID_TILE_SIZE, ty + VIVID_TILE_SIZE 
+    };
+
+    for (Uint32 i = d->tile_start[t]; i < d->tile_start[t + 1]; i++)
+        _vivid_command_run(d->context, &d->commands[d->tile_commands[i]], 
+            tile);
+}
+
+/*
+ * Rasterise tiles from this worker's own range, then steal what is left of
+ * the other workers' ranges. Tiles are claimed with an atomic increment so 
+ * every tile is drawn exactly once.
+ */
+void _vivid_worker_run(_vivid_worker* w) {
+    _vivid_deferred* d = w->deferred;
+    const int self = (int) (w - d->workers);
+
+    for (int i = 0; i < d->threads; i++) {
+        _vivid_worker* victim = &d->workers[(self + i) % d->threads];
+
+        int t;
+        while ((t = SDL_AtomicAdd(&victim->next, 1)) < victim->end)
+            _vivid_tile_run(d, t);
+    }
+}
+
+/*
+ * Worker thread loop, rasterises once per `vivid_flush` until the deferred 
+ * state is destroyed.
+ */
+int _vivid_worker_main(void* data) {
+    _vivid_worker* w = (_vivid_worker*) data;
+
+    while (1) {
+        SDL_SemWait(w->start);
+        if (SDL_AtomicGet(&w->deferred->quit))
+            break;
+
+        _vivid_worker_run(w);
+        SDL_SemPost(w->deferred->done);
+    }
+
+    return 0;
+}
+
+/*
+ * Create the frame buffers of a pipelined context and start its present
+ * thread. Waits until the thread has created the renderer and texture so 
+ * the context is complete when `vivid_create_ex` returns.
+ */
+Uint8 _vivid_present_start(vivid_context* context) {
+    _vivid_present* p = (_vivid_present*) calloc(1, sizeof(_vivid_present));
+    if (!p)
+        VIVID_PANIC("VIVID couldn't allocate the present state", VIVID_FAIL);
+
+    p->w = context->window_size.w;
+    p->h = context->window_size.h;
+    p->config = context->_config;
+    p->depth = context->_config.queue_depth;
+
+    // Every buffer starts as a copy of the window buffer
+    const size_t bs = sizeof(vivid_colour) * p->w * p->h;
+    p->slots[0].buffer = context->window_buffer;
+    for (int i = 1; i < p->depth; i++) {
+        p->slots[i].buffer = (vivid_colour*) malloc(bs);
+        if (!p->slots[i].buffer)
+            VIVID_PANIC("VIVID couldn't allocate a frame buffer", VIVID_FAIL);
+        memcpy(p->slots[i].buffer, context->window_buffer, bs);
+    }
+
+    // All but the buffer being drawn into are free
+    p->ready = SDL_CreateSemaphore(0);
+    p->free = SDL_CreateSemaphore(p->depth - 1);
+    p->started = SDL_CreateSemaphore(0);
+    if (!p->ready || !p->free || !p->started)
+        VIVID_PANIC(SDL_GetError(), VIVID_FAIL);
+
+    p->init = context;
+    p->thread = SDL_CreateThread(_vivid_present_main, "vivid_present", p);
+    if (!p->thread)
+        VIVID_PANIC(SDL_GetError(), VIVID_FAIL);
+
+    SDL_SemWait(p->started);
+    SDL_DestroySemaphore(p->started);
+    p->started = NULL;
+
+    // Panic here rather than on the present thread, which has already quit
+    if (p->error[0]) {
+        SDL_WaitThread(p->thread, NULL);
+        VIVID_PANIC(p->error, VIVID_FAIL);
+    }
+
+    context->_present = p;
+    return VIVID_OK;
+}
+
+/*
+ * Queue the finished frame for the present thread and move the context on to
+ * the next frame buffer. That buffer last held the frame `depth` frames ago,
+ * so the regions changed by the frames since are copied into it from the one
+ * just finished.
+ */
+void _vivid_present_submit(vivid_context* context) {
+    _vivid_present* p = context->_present;
+    _vivid_frame_slot* done = &p->slots[p->submitted % p->depth];
+
+    memcpy(done->dirty, context->_dirty, sizeof(done->dirty));
+    done->dirty_count = context->_dirty_count;
+    done->dirty_full = context->_dirty_full;
+
+    p->submitted++;
+    SDL_SemPost(p->ready);
+
+    // Blocks while every other buffer is still queued or on screen
+    SDL_SemWait(p->free);
+    _vivid_frame_slot* next = &p->slots[p->submitted % p->depth];
+
+    for (int i = 1; i < p->depth; i++) {
+        const _vivid_frame_slot* s = &p->slots[(p->submitted + i) % p->depth];
+
+        if (s->dirty_full) {
+            memcpy(next->buffer, done->buffer, 
+                sizeof(vivid_colour) * p->w * p->h);
+            break;
+        }
+
+        for (int j = 0; j < s->dirty_count; j++) {
+            const _vivid_box b = s->dirty[j];
+            for (int y = b.y0; y < b.y1; y++)
+                memcpy(next->buffer + y * p->w + b.x0, 
+                    done->buffer + y * p->w + b.x0, 
+                    sizeof(vivid_colour) * (b.x1 - b.x0));
+        }
+    }
+
+    context->window_buffer = next->buffer;
+
+    // Stage times are only known once a frame is on screen, so the profiler
+    // sees those of the frame presented from this buffer last
+    if (context->_profiler) {
+        context->_profiler->current.upload_ns = next->upload_ns;
+        context->_profiler->current.present_ns = next->present_ns;
+    }
+}
+
+/*
+ * Stop the present thread, dropping any queued frames, and free every frame
+ * buffer along with the present state.
+ */
+void _vivid_present_destroy(vivid_context* context) {
+    _vivid_present* p = context->_present;
+    if (!p)
+        return;
+
+    SDL_AtomicSet(&p->quit, 1);
+    SDL_SemPost(p->ready);
+    SDL_WaitThread(p->thread, NULL);
+
+    SDL_DestroySemaphore(p->ready);
+    SDL_DestroySemaphore(p->free);
+    for (int i = 0; i < p->depth; i++)
+        free(p->slots[i].buffer);
+    free(p);
+
+    context->_present = NULL;
+    context->window_buffer = NULL;
+    context->_renderer = NULL;
+    context->_texture = NULL;
+}
+
+/*
+ * Present thread loop. Creates the renderer and texture, as some renderers 
+ * can only be used from the thread that created them, then uploads and
+ * presents frames in submission order until the context is cleaned. A 
+ * renderer that can't be created on this thread is reported back through 
+ * `error` instead of panicking here.
+ */
+int _vivid_present_main(void* data) {
+    _vivid_present* p = (_vivid_present*) data;
+
+    Uint32 flags = p->config.renderer_flags;
+    if (p->config.vsync)
+        flags |= SDL_RENDERER_PRESENTVSYNC;
+
+    p->renderer = SDL_CreateRenderer(p->init->_window, -1, flags);
+    if (p->renderer)
+        p->texture = SDL_CreateTexture(p->renderer, SDL_PIXELFORMAT_ABGR8888,
+            SDL_TEXTUREACCESS_STREAMING, p->w, p->h);
+
+    // SDL keeps the error per thread, so copy it for the drawing thread
+    if (!p->texture) {
+        snprintf(p->error, sizeof(p->error), "%s", SDL_GetError());
+        if (p->renderer)
+            SDL_DestroyRenderer(p->renderer);
+        SDL_SemPost(p->started);
+        return VIVID_FAIL;
+    }
+
+    p->init->_renderer = p->renderer;
+    p->init->_texture = p->texture;
+    p->init = NULL;
+    SDL_SemPost(p->started);
+
+    while (1) {
+        SDL_SemWait(p->ready);
+        if (SDL_AtomicGet(&p->quit))
+            break;
+
+        _vivid_frame_slot* s = &p->slots[p->presented++ % p->depth];
+
+        Uint64 start = SDL_GetPerformanceCounter();
+        _vivid_upload(p->texture, s->buffer, NULL, NULL, p->w, p->h, 
+            s->dirty, s->dirty_count, s->dirty_full);
+        s->upload_ns = _vivid_profile_ns(start);
+
+        start = SDL_GetPerformanceCounter();
+        SDL_RenderCopy(p->renderer, p->texture, NULL, NULL);
+        SDL_RenderPresent(p->renderer);
+        s->present_ns = _vivid_profile_ns(start);
+
+        _vivid_pace(&p->pace_next, p->config.target_fps);
+        SDL_SemPost(p->free);
+    }
+
+    SDL_DestroyTexture(p->texture);
+    SDL_DestroyRenderer(p->renderer);
+
+    return 0;
+}
+
+/*
+ * Wait until the next frame is due when pacing to `fps` frames per second,
+ * `next` holds the performance counter value it is due at. A frame that runs
+ * late restarts the schedule instead of rushing the following frames.
+ */
+void _vivid_pace(Uint64* next, Uint16 fps) {
+    if (!fps)
+        return;
+
+    const Uint64 freq = SDL_GetPerformanceFrequency();
+    Uint64 now = SDL_GetPerformanceCounter();
+
+    if (*next <= now) {
+        *next = now + freq / fps;
+        return;
+    }
+
+    // Sleep the whole wait rounded up to a millisecond rather than spinning.
+    // Oversleeping doesn't drift, the schedule stays on `next`
+    const Uint64 ms = ((*next - now) * 1000 + freq - 1) / freq;
+    SDL_Delay((Uint32) ms);
+
+    *next += freq / fps;
+}
+
+/*
+ * Start recording every rendered frame to the file at `path`. Each 
+ * `vivid_render` copies the tiles changed since the last recorded frame into
+ * one of `buffers` preallocated buffers and a writer thread stores the ones
+ * that really differ, so the drawing thread never waits on the disk. When 
+ * every buffer is still queued `policy` either drops the frame 
+ * (`VIVID_CAPTURE_DROP`, its tiles are carried into the next frame) or waits 
+ * for the writer (`VIVID_CAPTURE_BLOCK`). Direct writes to `window_buffer` 
+ * are only recorded once marked with `vivid_mark_dirty`. Decode the file 
+ * with `tools/vivid_decode.c`, the format is:
+ *
+ *     Header, every field a little endian Uint32
+ *         "VIVIDCAP" (8 bytes), version, width, height, tile size
+ *     Then for each recorded frame
+ *         frame number       Counted from the first, gaps are dropped frames
+ *         tile count n
+ *         time (2 words)     Nanoseconds since the start as a Uint64
+ *         n tile indices     Ascending, tile i is column i % tiles_x, row 
+ *                            i / tiles_x, tiles_x = ceil(width / tile size)
+ *         pixels             Rows of each tile in turn (clipped to the 
+ *                            window), 4 bytes per pixel (r, g, b, a)
+ *
+ * The first frame stores every tile, the others only those that changed.
+ */
+Uint8 vivid_capture_start(vivid_context* context, const char* path, 
+        Uint8 buffers, Uint8 policy) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    if (context->_capture)
+        return VIVID_FAIL;
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return VIVID_FAIL;
+
+    const Uint32 header[4] = {
+        SDL_SwapLE32(VIVID_CAPTURE_VERSION), 
+        SDL_SwapLE32(context->window_size.w),
+        SDL_SwapLE32(context->window_size.h), 
+        SDL_SwapLE32(VIVID_TILE_SIZE)
+    };
+
+    if (fwrite(VIVID_CAPTURE_MAGIC, 8, 1, file) != 1 || 
+            fwrite(header, sizeof(header), 1, file) != 1) {
+        fclose(file);
+        return VIVID_FAIL;
+    }
+
+    // Large writes go straight through, the buffer batches the small ones
+    setvbuf(file, NULL, _IOFBF, 1 << 16);
+
+    _vivid_capture* cap = (_vivid_capture*) calloc(1, 
+        sizeof(_vivid_capture));
+    if (!cap)
+        VIVID_PANIC("VIVID couldn't allocate the capture state", VIVID_FAIL);
+
+    cap->file = file;
+    cap->w = context->window_size.w;
+    cap->h = context->window_size.h;
+    cap->tiles_x = context->_tiles_x;
+    cap->tiles_y = context->_tiles_y;
+    cap->policy = policy;
+    cap->depth = buffers < 1 ? 1 : 
+        buffers > VIVID_CAPTURE_MAX ? VIVID_CAPTURE_MAX : buffers;
+
+    // Every tile is stored in the first frame
+    const size_t tiles = (size_t) cap->tiles_x * cap->tiles_y;
+    const size_t bs = sizeof(Uint32) * cap->w * cap->h;
+    cap->pending = (Uint8*) malloc(tiles);
+    cap->last = (Uint32*) malloc(bs);
+    if (!cap->pending || !cap->last)
+        VIVID_PANIC("VIVID couldn't allocate the capture state", VIVID_FAIL);
+    memset(cap->pending, 1, tiles);
+
+    for (int i = 0; i < cap->depth; i++) {
+        cap->slots[i].tiles = (Uint32*) malloc(sizeof(Uint32) * tiles);
+        cap->slots[i].pixels = (Uint32*) malloc(bs);
+        if (!cap->slots[i].tiles || !cap->slots[i].pixels)
+            VIVID_PANIC("VIVID couldn't allocate a capture buffer", 
+                VIVID_FAIL);
+    }
+
+    cap->ready = SDL_CreateSemaphore(0);
+    cap->free = SDL_CreateSemaphore(cap->depth);
+    if (!cap->ready || !cap->free)
+        VIVID_PANIC(SDL_GetError(), VIVID_FAIL);
+
+    cap->start = SDL_GetPerformanceCounter();
+    cap->thread = SDL_CreateThread(_vivid_capture_main, "vivid_capture", 
+        cap);
+    if (!cap->thread)
+        VIVID_PANIC(SDL_GetError(), VIVID_FAIL);
+
+    context->_capture = cap;
+    return VIVID_OK;
+}
+
+/*
+ * Stop recording once the writer has stored every queued frame and close the
+ * file. A dropped last frame is recorded from the window buffer, so stop 
+ * straight after `vivid_render`. Fails if any part of the capture couldn't
+ * be written.
+ */
+Uint8 vivid_capture_stop(vivid_context* context) {
+    VIVID_ASSERT_CONTEXT(context);
+
+    _vivid_capture* cap = context->_capture;
+    if (!cap)
+        return VIVID_OK;
+
+    // Every buffer is free again once the queue has drained
+    for (int i = 0; i < cap->depth; i++)
+        SDL_SemWait(cap->free);
+
+    // Record the buffer in place of a dropped last frame, so the capture 
+    // ends on the frame last rendered
+    const _vivid_capture_slot* last = 
+        &cap->slots[(cap->queued - 1) % cap->depth];
+    if (cap->queued && last->frame != cap->frames - 1) {
+        cap->frames--;
+        cap->dropped--;
+        SDL_SemPost(cap->free);
+        _vivid_capture_frame(context);
+        SDL_SemWait(cap->free);
+    }
+
+    SDL_AtomicSet(&cap->quit, 1);
+    SDL_SemPost(cap->ready);
+    SDL_WaitThread(cap->thread, NULL);
+
+    Uint8 status = SDL_AtomicGet(&cap->failed) ? VIVID_FAIL : VIVID_OK;
+    if (fclose(cap->file) != 0)
+        status = VIVID_FAIL;
+
+    SDL_DestroySemaphore(cap->ready);
+    SDL_DestroySemaphore(cap->free);
+    for (int i = 0; i < cap->depth; i++) {
+        free(cap->slots[i].tiles);
+        free(cap->slots[i].pixels);
+    }
+    free(cap->pending);
+    free(cap->last);
+    free(cap);
+
+    context->_capture = NULL;
+    return status;
+}
+
+/*
+ * Fill `stats` with the frame counts of the running capture. Fails if the 
+ * context isn't capturing.
+ */
+Uint8 vivid_capture_query(vivid_context* context, 
+        vivid_capture_stats* stats) {
+
+    VIVID_ASSERT_CONTEXT(context);
+
+    _vivid_capture* cap = context->_capture;
+    if (!cap)
+        return VIVID_FAIL;
+
+    *stats = (vivid_capture_stats) {
+        .frames = cap->frames,
+        .queued = cap->queued,
+        .dropped = cap->dropped,
+        .written = (Uint32) SDL_AtomicGet(&cap->written)
+    };
+
+    return VIVID_OK;
+}
+
+/*
+ * Mark the tiles changed by the finished frame and, if a buffer is free (or
+ * once one is, with `VIVID_CAPTURE_BLOCK`), copy every marked tile into it 
+ * and queue it for the writer. Indexed tiles are expanded on the way.
+ */
+void _vivid_capture_frame(vivid_context* context) {
+    _vivid_capture* cap = context->_capture;
+    const Uint32 tiles = (Uint32) (cap->tiles_x * cap->tiles_y);
+    const Uint32 frame = cap->frames++;
+
+    if (context->_dirty_full)
+        memset(cap->pending, 1, tiles);
+
+    for (int i = 0; i < context->_dirty_count && !context->_dirty_full; i++) {
+        const _vivid_box b = context->_dirty[i];
+
+        for (int ty = b.y0 / VIVID_TILE_SIZE; 
+                ty <= (b.y1 - 1) / VIVID_TILE_SIZE; ty++)
+            memset(cap->pending + ty * cap->tiles_x + b.x0 / VIVID_TILE_SIZE,
+                1, (b.x1 - 1) / VIVID_TILE_SIZE - b.x0 / VIVID_TILE_SIZE + 1);
+    }
+
+    if (cap->policy == VIVID_CAPTURE_BLOCK) {
+        SDL_SemWait(cap->free);
+    } else if (SDL_SemTryWait(cap->free) != 0) {
+        cap->dropped++;
+        return;
+    }
+
+    _vivid_capture_slot* s = &cap->slots[cap->queued % cap->depth];
+    Uint32* dst = s->pixels;
+
+    s->frame = frame;
+    s->time_ns = _vivid_profile_ns(cap->start);
+    s->tile_count = 0;
+
+    for (Uint32 t = 0; t < tiles; t++) {
+        if (!cap->pending[t])
+            continue;
+
+        const _vivid_box b = _vivid_capture_tile(cap, t);
+        const int n = b.x1 - b.x0;
+
+        _vivid_tiles_ready(context, b);
+
+        for (int y = b.y0; y < b.y1; y++, dst += n) {
+            if (context->_indices)
+                _vivid_expand_impl(dst, context->_indices + y * cap->w + b.x0,
+                    n, context->_palette);
+            else
+                memcpy(dst, context->window_buffer + y * cap->w + b.x0, 
+                    sizeof(Uint32) * n);
+        }
+
+        cap->pending[t] = 0;
+        s->tiles[s->tile_count++] = t;
+    }
+
+    cap->queued++;
+    SDL_SemPost(cap->ready);
+}
+
+/*
+ * Store the frame in the slot `s`, keeping only the tiles that differ from
+ * the last frame written. They are packed to the front of the slot in place.
+ */
+Uint8 _vivid_capture_write(_vivid_capture* cap, _vivid_capture_slot* s) {
+    const Uint32* src = s->pixels;
+    Uint32* dst = s->pixels;
+    Uint32 kept = 0;
+
+    for (Uint32 i = 0; i < s->tile_count; i++) {
+        const Uint32 t = s->tiles[i];
+        const _vivid_box b = _vivid_capture_tile(cap, t);
+        const int n = b.x1 - b.x0;
+        const size_t size = (size_t) n * (b.y1 - b.y0);
+        Uint8 changed = !cap->stored;
+
+        for (int y = b.y0; y < b.y1; y++) {
+            Uint32* row = cap->last + y * cap->w + b.x0;
+            const Uint32* tile = src + (y - b.y0) * n;
+
+            if (!changed && !memcmp(row, tile, sizeof(Uint32) * n))
+                continue;
+
+            memcpy(row, tile, sizeof(Uint32) * n);
+            changed = 1;
+        }
+
+        if (changed) {
+            if (dst != src)
+                memmove(dst, src, sizeof(Uint32) * size);
+            dst += size;
+            s->tiles[kept++] = SDL_SwapLE32(t);
+        }
+
+        src += size;
+    }
+
+    const Uint32 header[4] = {
+        SDL_SwapLE32(s->frame),
+        SDL_SwapLE32(kept),
+        SDL_SwapLE32((Uint32) s->time_ns),
+        SDL_SwapLE32((Uint32) (s->time_ns >> 32))
+    };
+
+    const size_t pixels = (size_t) (dst - s->pixels);
+    if (fwrite(header, sizeof(header), 1, cap->file) != 1 ||
+            fwrite(s->tiles, sizeof(Uint32), kept, cap->file) != kept ||
+            fwrite(s->pixels, sizeof(Uint32), pixels, cap->file) != pixels)
+        return VIVID_FAIL;
+
+    cap->stored++;
+    return VIVID_OK;
+}
+
+/*
+ * Capture writer loop. Stores queued frames in order until the capture is
+ * stopped. After a failed write the remaining frames are only counted, so 
+ * the drawing thread is never stuck waiting on a buffer.
+ */
+int _vivid_capture_main(void* data) {
+    _vivid_capture* cap = (_vivid_capture*) data;
+    Uint32 next = 0;
+
+    while (1) {
+        SDL_SemWait(cap->ready);
+        if (SDL_AtomicGet(&cap->quit))
+            break;
+
+        _vivid_capture_slot* s = &cap->slots[next++ % cap->depth];
+
+        if (SDL_AtomicGet(&cap->failed)) {
+            // Keep returning buffers, there is nothing left to write to
+        } else if (_vivid_capture_write(cap, s) == VIVID_OK) {
+            SDL_AtomicAdd(&cap->written, 1);
+        } else {
+            SDL_AtomicSet(&cap->failed, 1);
+        }
+
+        SDL_SemPost(cap->free);
+    }
+
+    return 0;
+}
+
+/*
+ * The box covered by tile `t` of the capture, clipped to the window.
+ */
+_vivid_box _vivid_capture_tile(const _vivid_capture* cap, Uint32 t) {
+    const int x = (int) (t % cap->tiles_x) * VIVID_TILE_SIZE;
+    const int y = (int) (t / cap->tiles_x) * VIVID_TILE_SIZE;
+
+    return (_vivid_box) {
+        x, y,
+        x + VIVID_TILE_SIZE < cap->w ? x + VIVID_TILE_SIZE : cap->w,
+        y + VIVID_TILE_SIZE < cap->h ? y + VIVID_TILE_SIZE : cap->h
+    };
+}
+
+/*
+ * The box spanned by the line (x0, y0) to (x1, y1), grown by `pad` pixels on
+ * every side and clipped to the window buffer.
+ */
+_vivid_box _vivid_line_bounds(const vivid_context* context, int x0, int y0, 
+        int x1, int y1, int pad) {
+
+    const _vivid_box window = (_vivid_box) { 
+        0, 0, context->window_size.w, context->window_size.h 
+    };
+
+    return _vivid_box_clip(window, (_vivid_box) {
+        (x0 < x1 ? x0 : x1) - pad,
+        (y0 < y1 ? y0 : y1) - pad,
+        (x0 > x1 ? x0 : x1) + 1 + pad,
+        (y0 > y1 ? y0 : y1) + 1 + pad
+    });
+}
+
+/*
+ * Lines are stepped along their major axis, step `i` (0 to `dmaj`) being at
+ * `maj0 + smaj * i` on the major axis and `min0 + smin * m(i)` on the minor
+ * axis, where `m(i) = floor((2 * i * dmin + dmaj) / (2 * dmaj))` is the 
+ * rounded minor offset. Find the first and last step inside the major range
+ * [lo_maj, hi_maj) and minor range [lo_min, hi_min) given as the box `clip`
+ * (x major or y major already swapped in). Returns VIVID_FAIL when no step is
+ * visible. Because `m(i)` is monotonic both ranges can be solved directly.
+ */
+Uint8 _vivid_line_steps(int maj0, int smaj, int dmaj, int min0, int smin, 
+        int dmin, _vivid_box clip, int* first, int* last) {
+
+    Sint64 lo = 0, hi = dmaj;
+
+    // Major axis is a plain linear range
+    if (smaj > 0) {
+        if (clip.x0 - maj0 > lo) lo = clip.x0 - maj0;
+        if (clip.x1 - 1 - maj0 < hi) hi = clip.x1 - 1 - maj0;
+    } else {
+        if (maj0 - (clip.x1 - 1) > lo) lo = maj0 - (clip.x1 - 1);
+        if (maj0 - clip.x0 < hi) hi = maj0 - clip.x0;
+    }
+
+    // Minor offsets that land inside the clip
+    const Sint64 mlo = smin > 0 ? clip.y0 - min0 : min0 - (clip.y1 - 1);
+    const Sint64 mhi = smin > 0 ? clip.y1 - 1 - min0 : min0 - clip.y0;
+
+    if (dmin == 0) {
+        if (mlo > 0 || mhi < 0)
+            return VIVID_FAIL;
+    } else {
+        const Sint64 a = _vivid_div_ceil((2 * mlo - 1) * dmaj, 2 * dmin);
+        const Sint64 z = _vivid_div_ceil((2 * mhi + 1) * dmaj, 2 * dmin) - 1;
+        if (a > lo) lo = a;
+        if (z < hi) hi = z;
+    }
+
+    if (lo > hi)
+        return VIVID_FAIL;
+
+    *first = (int) lo;
+    *last = (int) hi;
+    return VIVID_OK;
+}
+
+/*
+ * Rasterise the visible steps of a line command inside the box `b`. Starts
+ * straight at the first visible step, so off-screen parts cost nothing.
+ */
+void _vivid_raster_line(vivid_context* context, const _vivid_command* command,
+        _vivid_box b) {
+
+    const int x0 = command->line.x0, y0 = command->line.y0;
+    const int dx = abs(command->line.x1 - x0);
+    const int dy = abs(command->line.y1 - y0);
+    const int sx = command->line.x1 < x0 ? -1 : 1;
+    const int sy = command->line.y1 < y0 ? -1 : 1;
+    const int stride = context->window_size.w;
+    const vivid_colour c = command->colour;
+
+    // Walk the longer axis, swapping the clip box to match
+    const int xmajor = dx >= dy;
+    const int dmaj = xmajor ? dx : dy, dmin = xmajor ? dy : dx;
+    const _vivid_box clip = xmajor ? b : (_vivid_box) { b.y0, b.x0, b.y1, b.x1 };
+
+    int first, last;
+    if (_vivid_line_steps(xmajor ? x0 : y0, xmajor ? sx : sy, dmaj, 
+            xmajor ? y0 : x0, xmajor ? sy : sx, dmin, clip, &first, &last))
+        return;
+
+    if (first < command->line.first)
+        first = command->line.first;
+    if (last > dmaj - command->line.trim)
+        last = dmaj - command->line.trim;
+    if (first > last)
+        return;
+
+    // Horizontal lines are a single span
+    if (dy == 0) {
+        _vivid_span(context, sx > 0 ? x0 + first : x0 - last, y0, 
+            last - first + 1, c);
+        return;
+    }
+
+    // Vertical lines are a single column, walked top down
+    if (dx == 0) {
+        const int top = sy > 0 ? y0 + first : y0 - last;
+        const int n = last - first + 1;
+
+        if (context->_indices) {
+            Uint8* ip = context->_indices + top * stride + x0;
+            for (int i = 0; i < n; i++, ip += stride)
+                *ip = c.r;
+        } else if (c.a == 255) {
+            vivid_colour* px = context->window_buffer + top * stride + x0;
+            for (int i = 0; i < n; i++, px += stride)
+                *px = c;
+        } else {
+            vivid_colour* px = context->window_buffer + top * stride + x0;
+            for (int i = 0; i < n; i++, px += stride)
+                px->hex = _vivid_blend_pixel(px->hex, c.hex);
+        }
+        return;
+    }
+
+    // Exact minor offset and remainder of the first step
+    const Sint64 den = 2 * (Sint64) dmaj;
+    const Sint64 num = 2 * (Sint64) first * dmin + dmaj;
+    Sint64 rem = num % den;
+    const Sint64 m = num / den;
+
+    const int x = xmajor ? x0 + sx * first : x0 + sx * (int) m;
+    const int y = xmajor ? y0 + sy * (int) m : y0 + sy * first;
+    vivid_colour* px = context->window_buffer + y * stride + x;
+
+    const int step_maj = xmajor ? sx : sy * stride;
+    const int step_min = xmajor ? sy * stride : sx;
+
+    if (context->_indices) {
+        Uint8* ip = context->_indices + y * stride + x;
+
+        for (int i = first; i <= last; i++, ip += step_maj) {
+            *ip = c.r;
+
+            rem += 2 * dmin;
+            if (rem >= den) {
+                rem -= den;
+                ip += step_min;
+            }
+        }
+        return;
+    }
+
+    for (int i = first; i <= last; i++, px += step_maj) {
+        if (c.a == 255)
+            *px = c;
+        else
+            px->hex = _vivid_blend_pixel(px->hex, c.hex);
+
+        rem += 2 * dmin;
+        if (rem >= den) {
+            rem -= den;
+            px += step_min;
+        }
+    }
+}
+
+/*
+ * Rasterise the visible steps of an anti-aliased line command inside the box
+ * `b`. The exact minor position of step `i` is `i * dmin / dmaj` in 16.16
+ * fixed point, kept as a quotient and remainder so it is identical no matter
+ * which step the walk starts from.
+ */
+void _vivid_raster_line_aa(vivid_context* context, 
+        const _vivid_command* command, _vivid_box b) {
+
+    const int x0 = command->line.x0, y0 = command->line.y0;
+    const int dx = abs(command->line.x1 - x0);
+    const int dy = abs(command->line.y1 - y0);
+    const int sx = command->line.x1 < x0 ? -1 : 1;
+    const int sy = command->line.y1 < y0 ? -1 : 1;
+    const int stride = context->window_size.w;
+    const vivid_colour c = command->colour;
+
+    const int xmajor = dx >= dy;
+    const int dmaj = xmajor ? dx : dy, dmin = xmajor ? dy : dx;
+    const int maj0 = xmajor ? x0 : y0, min0 = xmajor ? y0 : x0;
+    const int smaj = xmajor ? sx : sy, smin = xmajor ? sy : sx;
+    const _vivid_box clip = xmajor ? b : (_vivid_box) { b.y0, b.x0, b.y1, b.x1 };
+
+    // Both pixels of a step are within one of the rounded position, so the
+    // step range of the clip grown by one covers everything visible
+    int first, last;
+    if (_vivid_line_steps(maj0, smaj, dmaj, min0, smin, dmin, 
+            (_vivid_box) { clip.x0, clip.y0 - 1, clip.x1, clip.y1 + 1 }, 
+            &first, &last))
+        return;
+
+    const Sint64 step = dmaj ? ((Sint64) dmin << 16) : 0;
+    const Sint64 q = dmaj ? step / dmaj : 0;
+    const Sint64 r = dmaj ? step % dmaj : 0;
+    Sint64 pos = dmaj ? (step * first) / dmaj : 0;
+    Sint64 rem = dmaj ? (step * first) % dmaj : 0;
+
+    for (int i = first; i <= last; i++) {
+        const int maj = maj0 + smaj * i;
+
+        // Fixed point minor position, pixel below takes the inverse coverage.
+        // Lines starting off screen go negative, so floor without shifting
+        const Sint64 fix = (Sint64) min0 * 65536 + smin * pos;
+        Sint64 whole = fix / 65536, part = fix % 65536;
+        if (part < 0) {
+            part += 65536;
+            whole--;
+        }
+
+        const int lower = (int) whole;
+        const Uint32 frac = (Uint32) part;
+
+        for (int k = 0; k < 2; k++) {
+            const int mn = lower + k;
+            const Uint32 cover = k ? frac : 65536 - frac;
+            if (mn < clip.y0 || mn >= clip.y1 || cover == 0)
+                continue;
+
+            vivid_colour w = c;
+            w.a = (Uint8) ((c.a * cover + 32768) >> 16);
+            if (w.a == 0)
+                continue;
+
+            const int x = xmajor ? maj : mn;
+            const int y = xmajor ? mn : maj;
+            vivid_colour* px = context->window_buffer + y * stride + x;
+            px->hex = _vivid_blend_pixel(px->hex, w.hex);
+        }
+
+        pos += q;
+        rem += r;
+        if (rem >= dmaj && dmaj) {
+            rem -= dmaj;
+            pos++;
+        }
+    }
+}
+
+/*
+ * Rasterise a scaled or rotated sprite command inside the box `b`. Each row
+ * solves which pixels map inside the sprite, samples them into a scratch 
+ * row and blends that with the row kernels, straight alpha for nearest 
+ * sampling and premultiplied for bilinear. Source positions are exact 
+ * integer functions of the pixel, so tiles and clipping don't change them.
+ */
+void _vivid_raster_affine(vivid_context* context, 
+        const _vivid_command* command, _vivid_box b) {
+
+    const int stride = context->window_size.w;
+    const vivid_colour* pixels = command->affine.pixels;
+    const int w = command->affine.w, h = command->affine.h;
+    const Sint64 dudx = command->affine.dudx, dvdx = command->affine.dvdx;
+    vivid_colour scratch[VIVID_AFFINE_CHUNK];
+
+    for (int y = b.y0; y < b.y1; y++) {
+        const Sint64 ur = command->affine.u0 + 
+            (Sint64) command->affine.dudy * y;
+        const Sint64 vr = command->affine.v0 + 
+            (Sint64) command->affine.dvdy * y;
+
+        int x0 = b.x0, x1 = b.x1;
+        if (_vivid_affine_span(ur, dudx, (Sint64) w << 16, &x0, &x1) ||
+                _vivid_affine_span(vr, dvdx, (Sint64) h << 16, &x0, &x1))
+            continue;
+
+        vivid_colour* row = context->window_buffer + y * stride;
+
+        for (int x = x0; x < x1; x += VIVID_AFFINE_CHUNK) {
+            const int n = x1 - x < VIVID_AFFINE_CHUNK ? 
+                x1 - x : VIVID_AFFINE_CHUNK;
+            Sint64 u = ur + dudx * x, v = vr + dvdx * x;
+
+            if (command->affine.filter == VIVID_FILTER_BILINEAR) {
+                for (int i = 0; i < n; i++, u += dudx, v += dvdx)
+                    scratch[i].hex = _vivid_sample_bilinear(pixels, w, h, 
+                        u, v);
+                _vivid_blend_row_pm(row + x, scratch, n);
+            } else {
+                for (int i = 0; i < n; i++, u += dudx, v += dvdx)
+                    scratch[i] = pixels[(v >> 16) * w + (u >> 16)];
+                _vivid_blend_row(row + x, scratch, n);
+            }
+        }
+    }
+}
+
+/*
+ * Narrow the pixel range [`x0`, `x1`) to the pixels `x` where the 16.16 
+ * source coordinate `a + d * x` lies in [0, `limit`). Returns VIVID_FAIL 
+ * when no pixel is left.
+ */
+Uint8 _vivid_affine_span(Sint64 a, Sint64 d, Sint64 limit, int* x0, 
+        int* x1) {
+
+    Sint64 lo = *x0, hi = *x1;
+
+    if (d == 0) {
+        if (a < 0 || a >= limit)
+            return VIVID_FAIL;
+    } else if (d > 0) {
+        const Sint64 first = _vivid_div_ceil(-a, d);
+        const Sint64 end = _vivid_div_ceil(limit - a, d);
+        if (first > lo) lo = first;
+        if (end < hi) hi = end;
+    } else {
+        // floor(n / e) is -ceil(-n / e)
+        const Sint64 first = 1 - _vivid_div_ceil(limit - a, -d);
+        const Sint64 end = 1 - _vivid_div_ceil(-a, -d);
+        if (first > lo) lo = first;
+        if (end < hi) hi = end;
+    }
+
+    if (lo >= hi)
+        return VIVID_FAIL;
+
+    *x0 = (int) lo;
+    *x1 = (int) hi;
+    return VIVID_OK;
+}
+
+/*
+ * Bilinearly sample the `w` by `h` straight alpha sprite `pixels` at the 
+ * 16.16 position (`u`, `v`), clamping at the edges. Texels are premultiplied
+ * before they are weighted, so transparent texels don't bleed their colour,
+ * and the result is premultiplied.
+ */
+Uint32 _vivid_sample_bilinear(const vivid_colour* pixels, int w, int h, 
+        Sint64 u, Sint64 v) {
+
+    // Texel centres are at half pixels
+    const Sint64 tu = u - 0x8000, tv = v - 0x8000;
+    const int x = (int) (tu >> 16), y = (int) (tv >> 16);
+    const Uint32 fx = (Uint32) (tu >> 8) & 0xFF;
+    const Uint32 fy = (Uint32) (tv >> 8) & 0xFF;
+
+    const int x0 = x < 0 ? 0 : x, x1 = x + 1 < w ? x + 1 : w - 1;
+    const int y0 = y < 0 ? 0 : y, y1 = y + 1 < h ? y + 1 : h - 1;
+    const vivid_colour* r0 = pixels + y0 * w;
+    const vivid_colour* r1 = pixels + y1 * w;
+
+#if defined(VIVID_X86) && defined(__SSE2__)
+    // Both rows side by side in 16-bit lanes, same arithmetic as below
+    const __m128i zero = _mm_setzero_si128();
+    const __m128i amask = _mm_set_epi16(-1, 0, 0, 0, -1, 0, 0, 0);
+    __m128i t[2] = {
+        _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(r0[x0].hex),
+            _mm_cvtsi32_si128(r1[x0].hex)), zero),
+        _mm_unpacklo_epi8(_mm_unpacklo_epi32(_mm_cvtsi32_si128(r0[x1].hex),
+            _mm_cvtsi32_si128(r1[x1].hex)), zero)
+    };
+
+    for (int i = 0; i < 2; i++) {
+        const __m128i a = _mm_shufflehi_epi16(
+            _mm_shufflelo_epi16(t[i], 0xFF), 0xFF);
+        __m128i m = _mm_add_epi16(_mm_mullo_epi16(t[i], a), 
+            _mm_set1_epi16(0x80));
+        m = _mm_srli_epi16(_mm_add_epi16(m, _mm_srli_epi16(m, 8)), 8);
+        t[i] = _mm_or_si128(_mm_andnot_si128(amask, m), 
+            _mm_and_si128(amask, t[i]));
+    }
+
+    const __m128i lx = _mm_srli_epi16(_mm_add_epi16(
+        _mm_mullo_epi16(t[0], _mm_set1_epi16((short) (256 - fx))),
+        _mm_mullo_epi16(t[1], _mm_set1_epi16((short) fx))), 8);
+    const __m128i fv = _mm_set_epi16(fy, fy, fy, fy, 
+        256 - fy, 256 - fy, 256 - fy, 256 - fy);
+    __m128i r = _mm_mullo_epi16(lx, fv);
+    r = _mm_srli_epi16(_mm_add_epi16(r, _mm_srli_si128(r, 8)), 8);
+
+    return (Uint32) _mm_cvtsi128_si32(_mm_packus_epi16(r, r));
+#else
+    const Uint32 top = _vivid_lerp(_vivid_premultiply(r0[x0].hex), 
+        _vivid_premultiply(r0[x1].hex), fx);
+    const Uint32 bottom = _vivid_lerp(_vivid_premultiply(r1[x0].hex), 
+        _vivid_premultiply(r1[x1].hex), fx);
+
+    return _vivid_lerp(top, bottom, fy);
+#endif
+}
+
+/*
+ * Multiply the colour channels of `c` by its alpha, rounded exactly like
+ * `(x * a + 127) / 255`, two channels at a time.
+ */
+Uint32 _vivid_premultiply(Uint32 c) {
+    const Uint32 a = c >> 24;
+
+    Uint32 rb = (c & 0x00FF00FF) * a + 0x00800080;
+    Uint32 g  = ((c >> 8) & 0xFF) * a + 0x80;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    g  = ((g + (g >> 8)) >> 8) & 0xFF;
+
+    return (c & 0xFF000000) | (g << 8) | rb;
+}
+
+/*
+ * Interpolate from `a` to `b` by `f` / 256, all four channels in two 16-bit
+ * lanes per multiply.
+ */
+Uint32 _vivid_lerp(Uint32 a, Uint32 b, Uint32 f) {
+    const Uint32 rb = (((a & 0x00FF00FF) * (256 - f) + 
+        (b & 0x00FF00FF) * f) >> 8) & 0x00FF00FF;
+    const Uint32 ag = (((a >> 8) & 0x00FF00FF) * (256 - f) + 
+        ((b >> 8) & 0x00FF00FF) * f) & 0xFF00FF00;
+
+    return rb | ag;
+}
+
+/*
+ * Submit the triangle (x0, y0), (x1, y1), (x2, y2) with colour `c`, swapping
+ * two corners when needed so they run clockwise on screen. Triangles with no
+ * area cover no pixel centres and are skipped.
+ */
+Uint8 _vivid_submit_triangle(vivid_context* context, int x0, int y0, int x1, 
+        int y1, int x2, int y2, vivid_colour c) {
+
+    const Sint64 area = (Sint64) (x1 - x0) * (y2 - y0) - 
+        (Sint64) (y1 - y0) * (x2 - x0);
+    if (area == 0)
+        return VIVID_OK;
+
+    if (area < 0) {
+        const int tx = x1, ty = y1;
+        x1 = x2; y1 = y2;
+        x2 = tx; y2 = ty;
+    }
+
+    const _vivid_box window = (_vivid_box) { 
+        0, 0, context->window_size.w, context->window_size.h 
+    };
+
+    const int lx = x0 < x1 ? (x0 < x2 ? x0 : x2) : (x1 < x2 ? x1 : x2);
+    const int ly = y0 < y1 ? (y0 < y2 ? y0 : y2) : (y1 < y2 ? y1 : y2);
+    const int hx = x0 > x1 ? (x0 > x2 ? x0 : x2) : (x1 > x2 ? x1 : x2);
+    const int hy = y0 > y1 ? (y0 > y2 ? y0 : y2) : (y1 > y2 ? y1 : y2);
+
+    return _vivid_submit(context, &(_vivid_command) {
+        .type = VIVID_COMMAND_TRIANGLE,
+        .colour = c,
+        .bounds = _vivid_box_clip(window, 
+            (_vivid_box) { lx, ly, hx + 1, hy + 1 }),
+        .triangle = { x0, y0, x1, y1, x2, y2 }
+    });
+}
+
+/*
+ * Rasterise the pixels of a triangle command inside the box `b`. Each edge
+ * is an integer function `e(x, y) = a * x + b * y + c` that is non-negative
+ * inside, stepped incrementally. The box is walked in blocks, a block is
+ * skipped when one edge is negative at all its corners and filled as spans
+ * when every edge is non-negative at all of them. Runs of filled blocks are
+ * merged so large triangles are written as long spans. Only blocks on the
+ * outline test single pixels, and each of their rows is one span as the 
+ * triangle is convex.
+ */
+void _vivid_raster_triangle(vivid_context* context, 
+        const _vivid_command* command, _vivid_box b) {
+
+    const vivid_colour c = command->colour;
+    const int vx[3] = { 
+        command->triangle.x0, command->triangle.x1, command->triangle.x2 
+    };
+    const int vy[3] = { 
+        command->triangle.y0, command->triangle.y1, command->triangle.y2 
+    };
+
+    // Pixels exactly on an edge only pass for top and left edges, taking one
+    // from the other edges turns `e > 0` into `e >= 0`
+    Sint64 ea[3], eb[3], ec[3];
+    for (int i = 0; i < 3; i++) {
+        const int j = i == 2 ? 0 : i + 1;
+        const Sint64 dx = vx[j] - vx[i], dy = vy[j] - vy[i];
+
+        ea[i] = -dy;
+        eb[i] = dx;
+        ec[i] = dy * vx[i] - dx * vy[i];
+        if (!(dy < 0 || (dy == 0 && dx > 0)))
+            ec[i] -= 1;
+    }
+
+    for (int by = b.y0; by < b.y1; by += VIVID_TRIANGLE_BLOCK) {
+        const int bh = b.y1 - by < VIVID_TRIANGLE_BLOCK ? 
+            b.y1 - by : VIVID_TRIANGLE_BLOCK;
+
+        // Filled blocks from `run` up to the current one are still pending,
+        // the walk goes one block past the end of the row to write them
+        int run = -1;
+
+        for (int bx = b.x0; bx < b.x1 || run >= 0; 
+                bx += VIVID_TRIANGLE_BLOCK) {
+            const int bw = b.x1 - bx < VIVID_TRIANGLE_BLOCK ? 
+                b.x1 - bx : VIVID_TRIANGLE_BLOCK;
+
+            Sint64 e[3];
+            int inside = 0, outside = bw <= 0;
+
+            for (int i = 0; i < 3 && !outside; i++) {
+                e[i] = ea[i] * bx + eb[i] * by + ec[i];
+
+                // Smallest and largest value of the edge over the block
+                const Sint64 sx = ea[i] * (bw - 1), sy = eb[i] * (bh - 1);
+                const Sint64 lo = e[i] + (sx < 0 ? sx : 0) + (sy < 0 ? sy : 0);
+                const Sint64 hi = e[i] + (sx > 0 ? sx : 0) + (sy > 0 ? sy : 0);
+
+                outside = hi < 0;
+                inside += lo >= 0;
+            }
+
+            if (inside == 3 && !outside) {
+                if (run < 0)
+                    run = bx;
+                continue;
+            }
+
+            // Write the pending filled blocks as one span per row
+            if (run >= 0) {
+                const int n = (bx < b.x1 ? bx : b.x1) - run;
+                for (int y = 0; y < bh; y++)
+                    _vivid_span(context, run, by + y, n, c);
+                run = -1;
+            }
+
+            if (outside)
+                continue;
+
+            for (int y = 0; y < bh; y++) {
+                Sint64 e0 = e[0], e1 = e[1], e2 = e[2];
+                int x0 = 0;
+
+                // Any edge negative means the sign bit is set in the or
+                while (x0 < bw && (e0 | e1 | e2) < 0) {
+                    e0 += ea[0]; e1 += ea[1]; e2 += ea[2];
+                    x0++;
+                }
+
+                int x1 = x0;
+                while (x1 < bw && (e0 | e1 | e2) >= 0) {
+                    e0 += ea[0]; e1 += ea[1]; e2 += ea[2];
+                    x1++;
+                }
+
+                if (x1 > x0)
+                    _vivid_span(context, bx + x0, by + y, x1 - x0, c);
+
+                e[0] += eb[0]; e[1] += eb[1]; e[2] += eb[2];
+            }
+        }
+    }
+}
+
+/*
+ * Rasterise the rows of an ellipse command inside the box `b`. Pixel (x, y)
+ * is inside when `(x - cx)^2 * ry^2 + (y - cy)^2 * rx^2 <= rx^2 * ry^2`, so
+ * the half width of each row is an integer square root. Radii up to 65535
+ * keep every term inside 64 bits.
+ */
+void _vivid_raster_ellipse(vivid_context* context, 
+        const _vivid_command* command, _vivid_box b) {
+
+    const vivid_colour c = command->colour;
+    const int cx = command->ellipse.x, cy = command->ellipse.y;
+    const Uint64 rx = command->ellipse.rx, ry = command->ellipse.ry;
+
+    for (int y = b.y0; y < b.y1; y++) {
+        const Uint64 dy = (Uint64) abs(y - cy);
+
+        // A flat ellipse is a single row of its full width
+        const Sint64 k = ry == 0 ? (Sint64) rx : 
+            (Sint64) _vivid_isqrt(rx * rx * (ry * ry - dy * dy) / (ry * ry));
+
+        const int x0 = cx - k > b.x0 ? (int) (cx - k) : b.x0;
+        const int x1 = cx + k + 1 < b.x1 ? (int) (cx + k + 1) : b.x1;
+        if (x0 < x1)
+            _vivid_span(context, x0, y, x1 - x0, c);
+    }
+}
+
+/*
+ * Largest integer whose square is at most `n`. The floating point estimate 
+ * is corrected by at most a step or two either way.
+ */
+Uint64 _vivid_isqrt(Uint64 n) {
+    Uint64 r = (Uint64) SDL_sqrt((double) n);
+
+    while (r > 0 && (r > 0xFFFFFFFF || r * r > n))
+        r--;
+    while (r < 0xFFFFFFFF && (r + 1) * (r + 1) <= n)
+        r++;
+
+    return r;
+}
+
+/*
+ * Integer division of `a` by the positive `b`, rounding towards positive 
+ * infinity.
+ */
+Sint64 _vivid_div_ceil(Sint64 a, Sint64 b) {
+    return a >= 0 ? (a + b - 1) / b : -((-a) / b);
+}
+
+/*
+ * Intersect the rect `p` with the window buffer. The returned box is empty 
+ * (x0 >= x1 or y0 >= y1) when no part of the rect is inside the window.
+ */
+_vivid_box _vivid_clip_rect(const vivid_context* context, vivid_rect p) {
+    _vivid_box b = (_vivid_box) { 
+        .x0 = p.x, 
+        .y0 = p.y, 
+        .x1 = p.x + p.w, 
+        .y1 = p.y + p.h 
+    };
+
+    if (b.x0 < 0) b.x0 = 0;
+    if (b.y0 < 0) b.y0 = 0;
+    if (b.x1 > context->window_size.w) b.x1 = context->window_size.w;
+    if (b.y1 > context->window_size.h) b.y1 = context->window_size.h;
+
+    return b;
+}
+
+/*
+ * Intersect the two boxes `a` and `b`.
+ */
+_vivid_box _vivid_box_clip(_vivid_box a, _vivid_box b) {
+    return (_vivid_box) {
+        a.x0 > b.x0 ? a.x0 : b.x0,
+        a.y0 > b.y0 ? a.y0 : b.y0,
+        a.x1 < b.x1 ? a.x1 : b.x1,
+        a.y1 < b.y1 ? a.y1 : b.y1
+    };
+}
+
+/*
+ * Add the clipped box `b` to the dirty regions of the context. Boxes that 
+ * touch or overlap an existing region are merged into it, and once the list
+ * is full the new box is merged with whichever region grows the least.
+ */
+void _vivid_dirty_add(vivid_context* context, _vivid_box b) {
+    if (context->_dirty_full || b.x0 >= b.x1 || b.y0 >= b.y1)
+        return;
+
+    // Consecutive draws usually land in the same region
+    if (context->_dirty_count) {
+        const _vivid_box l = context->_dirty[context->_dirty_last];
+        if (b.x0 >= l.x0 && b.y0 >= l.y0 && b.x1 <= l.x1 && b.y1 <= l.y1)
+            return;
+    }
+
+    int i = 0;
+    while (i < context->_dirty_count) {
+        const _vivid_box d = context->_dirty[i];
+
+        if (b.x0 > d.x1 || b.x1 < d.x0 || b.y0 > d.y1 || b.y1 < d.y0) {
+            i++;
+            continue;
+        }
+
+        // Grow the new box over the region and retry against the others
+        b.x0 = d.x0 < b.x0 ? d.x0 : b.x0;
+        b.y0 = d.y0 < b.y0 ? d.y0 : b.y0;
+        b.x1 = d.x1 > b.x1 ? d.x1 : b.x1;
+        b.y1 = d.y1 > b.y1 ? d.y1 : b.y1;
+        context->_dirty[i] = context->_dirty[--context->_dirty_count];
+        i = 0;
+    }
+
+    if (context->_dirty_count == VIVID_DIRTY_MAX) {
+        int best = 0, best_growth = 0;
+
+        for (i = 0; i < context->_dirty_count; i++) {
+            const _vivid_box d = context->_dirty[i];
+            const int x0 = d.x0 < b.x0 ? d.x0 : b.x0;
+            const int y0 = d.y0 < b.y0 ? d.y0 : b.y0;
+            const int x1 = d.x1 > b.x1 ? d.x1 : b.x1;
+            const int y1 = d.y1 > b.y1 ? d.y1 : b.y1;
+            const int growth = (x1 - x0) * (y1 - y0) - 
+                (d.x1 - d.x0) * (d.y1 - d.y0);
+
+            if (i == 0 || growth < best_growth) {
+                best = i;
+                best_growth = growth;
+            }
+        }
+
+        // Merging can make the region overlap others, add it back in
+        const _vivid_box d = context->_dirty[best];
+        context->_dirty[best] = context->_dirty[--context->_dirty_count];
+        _vivid_dirty_add(context, (_vivid_box) {
+            d.x0 < b.x0 ? d.x0 : b.x0, 
+            d.y0 < b.y0 ? d.y0 : b.y0,
+            d.x1 > b.x1 ? d.x1 : b.x1, 
+            d.y1 > b.y1 ? d.y1 : b.y1
+        });
+        return;
+    }
+
+    context->_dirty_last = context->_dirty_count;
+    context->_dirty[context->_dirty_count++] = b;
+}
+
+/*
+ * Record that the clipped box `b` is about to be drawn to, filling any tile it
+ * overlaps that is still waiting for a lazy clear first.
+ */
+void _vivid_tiles_touch(vivid_context* context, _vivid_box b) {
+    if (b.x0 >= b.x1 || b.y0 >= b.y1)
+        return;
+
+    _vivid_tiles_ready(context, b);
+
+    for (int ty = b.y0 / VIVID_TILE_SIZE; 
+            ty <= (b.y1 - 1) / VIVID_TILE_SIZE; ty++)
+        for (int tx = b.x0 / VIVID_TILE_SIZE; 
+                tx <= (b.x1 - 1) / VIVID_TILE_SIZE; tx++)
+            context->_tiles[ty * context->_tiles_x + tx].drawn = 
+                context->_clear_gen;
+}
+
+/*
+ * Fill every tile overlapping the clipped box `b` that hasn't been cleared
+ * since the last lazy `vivid_clear` with the clear colour.
+ */
+void _vivid_tiles_ready(vivid_context* context, _vivid_box b) {
+    if (!context->_lazy_clear || b.x0 >= b.x1 || b.y0 >= b.y1)
+        return;
+
+    const int stride = context->window_size.w;
+
+    for (int ty = b.y0 / VIVID_TILE_SIZE; 
+            ty <= (b.y1 - 1) / VIVID_TILE_SIZE; ty++) {
+        for (int tx = b.x0 / VIVID_TILE_SIZE; 
+                tx <= (b.x1 - 1) / VIVID_TILE_SIZE; tx++) {
+            _vivid_clear_tile* tile = &context->_tiles[ty * context->_tiles_x +
+                tx];
+            if (tile->valid == context->_clear_gen)
+                continue;
+
+            const int x0 = tx * VIVID_TILE_SIZE, y0 = ty * VIVID_TILE_SIZE;
+            const int x1 = x0 + VIVID_TILE_SIZE < stride ? 
+                x0 + VIVID_TILE_SIZE : stride;
+            const int y1 = y0 + VIVID_TILE_SIZE < context->window_size.h ? 
+                y0 + VIVID_TILE_SIZE : context->window_size.h;
+
+            for (int y = y0; y < y1; y++)
+                _vivid_fill_row(context->window_buffer + y * stride + x0, 
+                    x1 - x0, context->_clear_value);
+            tile->valid = context->_clear_gen;
+        }
+    }
+}
+
+/*
+ * Bring `texture` up to date with the `w` by `h` frame `buffer` given the 
+ * `count` regions in `dirty` that changed since the last upload. When `full`
+ * is set or most of the frame changed the whole buffer is uploaded in one go.
+ * When `indices` is set the frame is read from it through `palette` instead.
+ */
+void _vivid_upload(SDL_Texture* texture, const vivid_colour* buffer, 
+        const Uint8* indices, const Uint32* palette, int w, int h, 
+        const _vivid_box* dirty, int count, Uint8 full) {
+
+    // Merged regions can overlap, so compare against the frame area
+    int area = 0;
+    for (int i = 0; i < count; i++)
+        area += (dirty[i].x1 - dirty[i].x0) * (dirty[i].y1 - dirty[i].y0);
+
+    if (full || area >= w * h / 2) {
+        _vivid_upload_box(texture, buffer, indices, palette, w, 
+            (_vivid_box) { 0, 0, w, h });
+        return;
+    }
+
+    for (int i = 0; i < count; i++)
+        _vivid_upload_box(texture, buffer, indices, palette, w, dirty[i]);
+}
+
+/*
+ * Copy the box `b` of the frame `buffer`, `stride` pixels wide, into the 
+ * streaming texture, a row at a time so the pitch SDL returns is respected.
+ * Indexed frames are looked up in `palette` straight into the texture.
+ */
+void _vivid_upload_box(SDL_Texture* texture, const vivid_colour* buffer, 
+        const Uint8* indices, const Uint32* palette, int stride, 
+        _vivid_box b) {
+
+    const SDL_Rect r = { b.x0, b.y0, b.x1 - b.x0, b.y1 - b.y0 };
+    Uint8* pixels;
+    int pitch;
+
+    if (SDL_LockTexture(texture, &r, (void**) &pixels, &pitch) < 0)
+        return;
+
+    if (indices) {
+        const Uint8* src = indices + b.y0 * stride + b.x0;
+        for (int y = b.y0; y < b.y1; y++, src += stride, pixels += pitch)
+            _vivid_expand_impl((Uint32*) pixels, src, r.w, palette);
+
+        SDL_UnlockTexture(texture);
+        return;
+    }
+
+    const vivid_colour* src = buffer + b.y0 * stride + b.x0;
+    for (int y = b.y0; y < b.y1; y++, src += stride, pixels += pitch)
+        memcpy(pixels, src, sizeof(vivid_colour) * r.w);
+
+    SDL_UnlockTexture(texture);
+}
+
+/*
+ * Fill the `n` pixels from (x, y) with colour `c`, blending unless it is 
+ * opaque. Indexed contexts store its palette index instead.
+ */
+void _vivid_span(vivid_context* context, int x, int y, int n, 
+        vivid_colour c) {
+
+    const size_t i = (size_t) y * context->window_size.w + x;
+
+    if (context->_indices)
+        memset(context->_indices + i, c.r, n);
+    else if (c.a == 255)
+        _vivid_fill_row(context->window_buffer + i, n, c);
+    else
+        _vivid_blend_fill_row(context->window_buffer + i, n, c);
+}
+
+/*
+ * Store `n` copies of the opaque colour `c` starting at `dst`. Uses 128-bit
+ * stores when SSE2 is available.
+ */
+void _vivid_fill_row(vivid_colour* dst, int n, vivid_colour c) {
+    int i = 0;
+
+#if defined(VIVID_X86) && defined(__SSE2__)
+    const __m128i v = _mm_set1_epi32((int) c.hex);
+    for (; i + 4 <= n; i += 4)
+        _mm_storeu_si128((__m128i*) (dst + i), v);
+#endif
+
+    for (; i < n; i++)
+        dst[i] = c;
+}
+
+/*
+ * Store `n` copies of the colour `c` starting at `dst`, for whole buffers. 
+ * The SSE2 path uses non-temporal stores, so clearing a frame that doesn't 
+ * fit in the cache doesn't first read every line into it.
+ */
+void _vivid_clear_buffer(vivid_colour* dst, size_t n, vivid_colour c) {
+    size_t i = 0;
+
+#if defined(VIVID_X86) && defined(__SSE2__)
+    // Streaming stores have to be 16 byte aligned
+    for (; i < n && ((uintptr_t) (dst + i) & 15); i++)
+        dst[i] = c;
+
+    const __m128i v = _mm_set1_epi32((int) c.hex);
+    for (; i + 16 <= n; i += 16) {
+        _mm_stream_si128((__m128i*) (dst + i), v);
+        _mm_stream_si128((__m128i*) (dst + i + 4), v);
+        _mm_stream_si128((__m128i*) (dst + i + 8), v);
+        _mm_stream_si128((__m128i*) (dst + i + 12), v);
+    }
+    _mm_sfence();
+#endif
+
+    for (; i < n; i++)
+        dst[i] = c;
+}
+
+/*
+ * Alpha blend the colour `c` onto `n` pixels starting at `dst`.
+ */
+void _vivid_blend_fill_row(vivid_colour* dst, int n, vivid_colour c) {
+    _vivid_blend_fill_impl(dst, n, c);
+}
+
+/*
+ * Alpha blend `n` pixels of `src`, each with its own alpha, onto `dst`.
+ */
+void _vivid_blend_row(vivid_colour* dst, const vivid_colour* src, int n) {
+    _vivid_blend_row_impl(dst, src, n);
+}
+
+/*
+ * Blend `n` premultiplied pixels of `src` onto `dst`.
+ */
+void _vivid_blend_row_pm(vivid_colour* dst, const vivid_colour* src, int n) {
+    _vivid_blend_row_pm_impl(dst, src, n);
+}
+
+/*
+ * Alpha blend the colour `s` onto the colour `d` and return the opaque result.
+ * Every blend kernel uses this exact integer form of 
+ * `(s * a + d * (255 - a)) / 255` rounded to nearest, computing red and blue
+ * together in one 32-bit word and green in another, so the scalar and vector
+ * paths produce identical pixels.
+ */
+Uint32 _vivid_blend_pixel(Uint32 d, Uint32 s) {
+    const Uint32 a  = s >> 24;
+    const Uint32 ia = 255 - a;
+
+    Uint32 rb = (s & 0x00FF00FF) * a + (d & 0x00FF00FF) * ia + 0x00800080;
+    Uint32 g  = ((s >> 8) & 0xFF) * a + ((d >> 8) & 0xFF) * ia + 0x80;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    g  = ((g + (g >> 8)) >> 8) & 0xFF;
+
+    return 0xFF000000 | (g << 8) | rb;
+}
+
+/*
+ * Blend the premultiplied colour `s` onto `d`. Only the destination needs 
+ * weighting, `s + d * (255 - a) / 255`, which can't exceed 255 per channel.
+ */
+Uint32 _vivid_blend_pixel_pm(Uint32 d, Uint32 s) {
+    const Uint32 ia = 255 - (s >> 24);
+
+    Uint32 rb = (d & 0x00FF00FF) * ia + 0x00800080;
+    Uint32 g  = ((d >> 8) & 0xFF) * ia + 0x80;
+    rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+    g  = ((g + (g >> 8)) >> 8) & 0xFF;
+
+    return 0xFF000000 | ((s & 0x00FFFFFF) + ((g << 8) | rb));
+}
+
+/*
+ * Use SDL's CPU detection to replace the scalar blend kernels with the widest
+ * vector version available. Safe to call more than once.
+ */
+void _vivid_select_kernels(void) {
+    _vivid_blend_fill_impl   = _vivid_blend_fill_row_scalar;
+    _vivid_blend_row_impl    = _vivid_blend_row_scalar;
+    _vivid_blend_row_pm_impl = _vivid_blend_row_pm_scalar;
+    _vivid_expand_impl       = _vivid_expand_row_scalar;
+
+#if defined(VIVID_X86)
+    if (SDL_HasAVX2()) {
+        _vivid_blend_fill_impl   = _vivid_blend_fill_row_avx2;
+        _vivid_blend_row_impl    = _vivid_blend_row_avx2;
+        _vivid_blend_row_pm_impl = _vivid_blend_row_pm_avx2;
+        _vivid_expand_impl       = _vivid_expand_row_avx2;
+    } else if (SDL_HasSSE2()) {
+        _vivid_blend_fill_impl   = _vivid_blend_fill_row_sse2;
+        _vivid_blend_row_impl    = _vivid_blend_row_sse2;
+        _vivid_blend_row_pm_impl = _vivid_blend_row_pm_sse2;
+    }
+#endif
+}
+
+void _vivid_blend_fill_row_scalar(vivid_colour* dst, int n, vivid_colour c) {
+    const Uint32 a  = c.a;
+    const Uint32 ia = 255 - a;
+
+    // Source contribution (and rounding bias) is the same for every pixel
+    const Uint32 srb = (c.hex & 0x00FF00FF) * a + 0x00800080;
+    const Uint32 sg  = ((c.hex >> 8) & 0xFF) * a + 0x80;
+
+    for (int i = 0; i < n; i++) {
+        const Uint32 d = dst[i].hex;
+
+        Uint32 rb = (d & 0x00FF00FF) * ia + srb;
+        Uint32 g  = ((d >> 8) & 0xFF) * ia + sg;
+        rb = ((rb + ((rb >> 8) & 0x00FF00FF)) >> 8) & 0x00FF00FF;
+        g  = ((g + (g >> 8)) >> 8) & 0xFF;
+
+        dst[i].hex = 0xFF000000 | (g << 8) | rb;
+    }
+}
+
+void _vivid_blend_row_scalar(vivid_colour* dst, const vivid_colour* src, 
+        int n) {
+
+    for (int i = 0; i < n; i++)
+        dst[i].hex = _vivid_blend_pixel(dst[i].hex, src[i].hex);
+}
+
+void _vivid_blend_row_pm_scalar(vivid_colour* dst, const vivid_colour* src, 
+        int n) {
+
+    for (int i = 0; i < n; i++)
+        dst[i].hex = _vivid_blend_pixel_pm(dst[i].hex, src[i].hex);
+}
+
+/*
+ * Look the `n` palette indices of `src` up in `palette` and store the 
+ * colours in `dst`.
+ */
+void _vivid_expand_row_scalar(Uint32* dst, const Uint8* src, int n, 
+        const Uint32* palette) {
+
+    for (int i = 0; i < n; i++)
+        dst[i] = palette[src[i]];
+}
+
+#if defined(VIVID_X86)
+
+/*
+ * The vector kernels widen each channel to 16 bits, where `s * a + d * ia` 
+ * plus the rounding bias never exceeds 65153, so `(t + (t >> 8)) >> 8` gives
+ * the same result as `_vivid_blend_pixel` without leaving 16-bit lanes.
+ */
+__attribute__((target("sse2")))
+void _vivid_blend_fill_row_sse2(vivid_colour* dst, int n, vivid_colour c) {
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32((int) 0xFF000000);
+    const __m128i bias   = _mm_set1_epi16(0x80);
+
+    // Premultiplied source plus bias and inverse alpha, shared by all pixels
+    const __m128i s   = _mm_unpacklo_epi8(_mm_set1_epi32((int) c.hex), zero);
+    const __m128i sa  = _mm_add_epi16(
+        _mm_mullo_epi16(s, _mm_set1_epi16(c.a)), bias);
+    const __m128i ia  = _mm_set1_epi16(255 - c.a);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i d = _mm_loadu_si128((const __m128i*) (dst + i));
+
+        __m128i lo = _mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpacklo_epi8(d, zero), ia), sa);
+        __m128i hi = _mm_add_epi16(
+            _mm_mullo_epi16(_mm_unpackhi_epi8(d, zero), ia), sa);
+        lo = _mm_srli_epi16(_mm_add_epi16(lo, _mm_srli_epi16(lo, 8)), 8);
+        hi = _mm_srli_epi16(_mm_add_epi16(hi, _mm_srli_epi16(hi, 8)), 8);
+
+        _mm_storeu_si128((__m128i*) (dst + i), 
+            _mm_or_si128(_mm_packus_epi16(lo, hi), opaque));
+    }
+
+    _vivid_blend_fill_row_scalar(dst + i, n - i, c);
+}
+
+__attribute__((target("sse2")))
+void _vivid_blend_row_sse2(vivid_colour* dst, const vivid_colour* src, 
+        int n) {
+
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32((int) 0xFF000000);
+    const __m128i bias   = _mm_set1_epi16(0x80);
+    const __m128i full   = _mm_set1_epi16(0xFF);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i d = _mm_loadu_si128((const __m128i*) (dst + i));
+        const __m128i s = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i t[2];
+
+        for (int h = 0; h < 2; h++) {
+            const __m128i dw = h ? _mm_unpackhi_epi8(d, zero) 
+                                 : _mm_unpacklo_epi8(d, zero);
+            const __m128i sw = h ? _mm_unpackhi_epi8(s, zero) 
+                                 : _mm_unpacklo_epi8(s, zero);
+
+            // Broadcast each pixel's alpha across its four channels
+            __m128i a = _mm_shufflelo_epi16(sw, _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m128i v = _mm_add_epi16(_mm_add_epi16(
+                _mm_mullo_epi16(sw, a),
+                _mm_mullo_epi16(dw, _mm_sub_epi16(full, a))), bias);
+            t[h] = _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+        }
+
+        _mm_storeu_si128((__m128i*) (dst + i), 
+            _mm_or_si128(_mm_packus_epi16(t[0], t[1]), opaque));
+    }
+
+    _vivid_blend_row_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("sse2")))
+void _vivid_blend_row_pm_sse2(vivid_colour* dst, const vivid_colour* src, 
+        int n) {
+
+    const __m128i zero   = _mm_setzero_si128();
+    const __m128i opaque = _mm_set1_epi32((int) 0xFF000000);
+    const __m128i rgb    = _mm_set1_epi32(0x00FFFFFF);
+    const __m128i bias   = _mm_set1_epi16(0x80);
+    const __m128i full   = _mm_set1_epi16(0xFF);
+
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        const __m128i d = _mm_loadu_si128((const __m128i*) (dst + i));
+        const __m128i s = _mm_loadu_si128((const __m128i*) (src + i));
+        __m128i t[2];
+
+        for (int h = 0; h < 2; h++) {
+            const __m128i dw = h ? _mm_unpackhi_epi8(d, zero) 
+                                 : _mm_unpacklo_epi8(d, zero);
+            const __m128i sw = h ? _mm_unpackhi_epi8(s, zero) 
+                                 : _mm_unpacklo_epi8(s, zero);
+
+            __m128i a = _mm_shufflelo_epi16(sw, _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m128i v = _mm_add_epi16(
+                _mm_mullo_epi16(dw, _mm_sub_epi16(full, a)), bias);
+            t[h] = _mm_srli_epi16(_mm_add_epi16(v, _mm_srli_epi16(v, 8)), 8);
+        }
+
+        const __m128i o = _mm_add_epi8(_mm_packus_epi16(t[0], t[1]), 
+            _mm_and_si128(s, rgb));
+        _mm_storeu_si128((__m128i*) (dst + i), _mm_or_si128(o, opaque));
+    }
+
+    _vivid_blend_row_pm_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void _vivid_blend_fill_row_avx2(vivid_colour* dst, int n, vivid_colour c) {
+    const __m256i zero   = _mm256_setzero_si256();
+    const __m256i opaque = _mm256_set1_epi32((int) 0xFF000000);
+    const __m256i bias   = _mm256_set1_epi16(0x80);
+
+    const __m256i s  = _mm256_unpacklo_epi8(
+        _mm256_set1_epi32((int) c.hex), zero);
+    const __m256i sa = _mm256_add_epi16(
+        _mm256_mullo_epi16(s, _mm256_set1_epi16(c.a)), bias);
+    const __m256i ia = _mm256_set1_epi16(255 - c.a);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i d = _mm256_loadu_si256((const __m256i*) (dst + i));
+
+        __m256i lo = _mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpacklo_epi8(d, zero), ia), sa);
+        __m256i hi = _mm256_add_epi16(
+            _mm256_mullo_epi16(_mm256_unpackhi_epi8(d, zero), ia), sa);
+        lo = _mm256_srli_epi16(
+            _mm256_add_epi16(lo, _mm256_srli_epi16(lo, 8)), 8);
+        hi = _mm256_srli_epi16(
+            _mm256_add_epi16(hi, _mm256_srli_epi16(hi, 8)), 8);
+
+        // Unpack and pack both work per 128-bit lane, so pixel order holds
+        _mm256_storeu_si256((__m256i*) (dst + i), 
+            _mm256_or_si256(_mm256_packus_epi16(lo, hi), opaque));
+    }
+
+    _vivid_blend_fill_row_scalar(dst + i, n - i, c);
+}
+
+__attribute__((target("avx2")))
+void _vivid_blend_row_avx2(vivid_colour* dst, const vivid_colour* src, 
+        int n) {
+
+    const __m256i zero   = _mm256_setzero_si256();
+    const __m256i opaque = _mm256_set1_epi32((int) 0xFF000000);
+    const __m256i bias   = _mm256_set1_epi16(0x80);
+    const __m256i full   = _mm256_set1_epi16(0xFF);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i d = _mm256_loadu_si256((const __m256i*) (dst + i));
+        const __m256i s = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i t[2];
+
+        for (int h = 0; h < 2; h++) {
+            const __m256i dw = h ? _mm256_unpackhi_epi8(d, zero) 
+                                 : _mm256_unpacklo_epi8(d, zero);
+            const __m256i sw = h ? _mm256_unpackhi_epi8(s, zero) 
+                                 : _mm256_unpacklo_epi8(s, zero);
+
+            __m256i a = _mm256_shufflelo_epi16(sw, _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m256i v = _mm256_add_epi16(_mm256_add_epi16(
+                _mm256_mullo_epi16(sw, a),
+                _mm256_mullo_epi16(dw, _mm256_sub_epi16(full, a))), bias);
+            t[h] = _mm256_srli_epi16(
+                _mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+        }
+
+        _mm256_storeu_si256((__m256i*) (dst + i), 
+            _mm256_or_si256(_mm256_packus_epi16(t[0], t[1]), opaque));
+    }
+
+    _vivid_blend_row_scalar(dst + i, src + i, n - i);
+}
+
+__attribute__((target("avx2")))
+void _vivid_blend_row_pm_avx2(vivid_colour* dst, const vivid_colour* src, 
+        int n) {
+
+    const __m256i zero   = _mm256_setzero_si256();
+    const __m256i opaque = _mm256_set1_epi32((int) 0xFF000000);
+    const __m256i rgb    = _mm256_set1_epi32(0x00FFFFFF);
+    const __m256i bias   = _mm256_set1_epi16(0x80);
+    const __m256i full   = _mm256_set1_epi16(0xFF);
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i d = _mm256_loadu_si256((const __m256i*) (dst + i));
+        const __m256i s = _mm256_loadu_si256((const __m256i*) (src + i));
+        __m256i t[2];
+
+        for (int h = 0; h < 2; h++) {
+            const __m256i dw = h ? _mm256_unpackhi_epi8(d, zero) 
+                                 : _mm256_unpacklo_epi8(d, zero);
+            const __m256i sw = h ? _mm256_unpackhi_epi8(s, zero) 
+                                 : _mm256_unpacklo_epi8(s, zero);
+
+            __m256i a = _mm256_shufflelo_epi16(sw, _MM_SHUFFLE(3, 3, 3, 3));
+            a = _mm256_shufflehi_epi16(a, _MM_SHUFFLE(3, 3, 3, 3));
+
+            __m256i v = _mm256_add_epi16(
+                _mm256_mullo_epi16(dw, _mm256_sub_epi16(full, a)), bias);
+            t[h] = _mm256_srli_epi16(
+                _mm256_add_epi16(v, _mm256_srli_epi16(v, 8)), 8);
+        }
+
+        const __m256i o = _mm256_add_epi8(_mm256_packus_epi16(t[0], t[1]), 
+            _mm256_and_si256(s, rgb));
+        _mm256_storeu_si256((__m256i*) (dst + i), _mm256_or_si256(o, opaque));
+    }
+
+    _vivid_blend_row_pm_scalar(dst + i, src + i, n - i);
+}
+
+/*
+ * Widen eight indices at a time to 32 bits and fetch their colours with a 
+ * single gather.
+ */
+__attribute__((target("avx2")))
+void _vivid_expand_row_avx2(Uint32* dst, const Uint8* src, int n, 
+        const Uint32* palette) {
+
+    int i = 0;
+    for (; i + 8 <= n; i += 8) {
+        const __m256i index = _mm256_cvtepu8_epi32(
+            _mm_loadl_epi64((const __m128i*) (src + i)));
+        _mm256_storeu_si256((__m256i*) (dst + i), 
+            _mm256_i32gather_epi32((const int*) palette, index, 4));
+    }
+
+    _vivid_expand_row_scalar(dst + i, src + i, n - i, palette);
+}
+
+#endif
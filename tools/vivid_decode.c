@@ -0,0 +1,203 @@
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+
+/*
+ * Decodes a capture recorded with `vivid_capture_start` back into frames.
+ * Frames dropped while recording are filled in with the frame before them,
+ * so the output keeps the original frame timing. Doesn't need SDL.
+ *
+ * Usage: vivid_decode <capture> <prefix>
+ *     Write every frame as a binary PPM image named <prefix>000000.ppm,
+ *     <prefix>000001.ppm and so on.
+ *
+ * Usage: vivid_decode <capture> -
+ *     Write every frame to stdout as raw r, g, b, a bytes instead, e.g.
+ *     vivid_decode session.vcap - | ffmpeg -f rawvideo -pix_fmt rgba \
+ *         -s 1920x1080 -r 60 -i - session.mp4
+ */
+
+#define DECODE_MAGIC    "VIVIDCAP"
+#define DECODE_VERSION  1
+
+typedef struct _decoder {
+    FILE*       in;
+    FILE*       out;        // Raw frames, NULL when writing PPM images
+    const char* prefix;
+    uint32_t    w, h, tile, tiles_x, tiles_y;
+    uint8_t*    frame;      // The current frame, 4 bytes per pixel
+    uint8_t*    row;        // A PPM row, 3 bytes per pixel
+    uint32_t*   tiles;
+    uint32_t    emitted;
+} decoder;
+
+/*
+ * Read `n` little endian 32-bit words, returns 0 at the end of the file.
+ */
+static int read_words(FILE* in, uint32_t* words, size_t n) {
+    uint8_t bytes[4];
+
+    for (size_t i = 0; i < n; i++) {
+        if (fread(bytes, 4, 1, in) != 1)
+            return 0;
+        words[i] = (uint32_t) bytes[0] | (uint32_t) bytes[1] << 8 |
+            (uint32_t) bytes[2] << 16 | (uint32_t) bytes[3] << 24;
+    }
+
+    return 1;
+}
+
+/*
+ * Write the current frame as the next output frame.
+ */
+static int emit(decoder* d) {
+    const size_t n = (size_t) d->w * d->h;
+
+    if (d->out) {
+        if (fwrite(d->frame, 4, n, d->out) != n)
+            return 0;
+        d->emitted++;
+        return 1;
+    }
+
+    char path[4096];
+    snprintf(path, sizeof(path), "%s%06u.ppm", d->prefix, d->emitted);
+
+    FILE* file = fopen(path, "wb");
+    if (!file)
+        return 0;
+
+    int ok = fprintf(file, "P6\n%u %u\n255\n", d->w, d->h) > 0;
+
+    for (uint32_t y = 0; y < d->h && ok; y++) {
+        const uint8_t* src = d->frame + (size_t) y * d->w * 4;
+        for (uint32_t x = 0; x < d->w; x++) {
+            d->row[3 * x + 0] = src[4 * x + 0];
+            d->row[3 * x + 1] = src[4 * x + 1];
+            d->row[3 * x + 2] = src[4 * x + 2];
+        }
+
+        ok = fwrite(d->row, 3, d->w, file) == d->w;
+    }
+
+    if (fclose(file) != 0)
+        ok = 0;
+
+    d->emitted++;
+    return ok;
+}
+
+/*
+ * Read the tiles of one frame record into the current frame.
+ */
+static int read_tiles(decoder* d, uint32_t count) {
+    const uint32_t total = d->tiles_x * d->tiles_y;
+
+    if (count > total || !read_words(d->in, d->tiles, count))
+        return 0;
+
+    for (uint32_t i = 0; i < count; i++) {
+        const uint32_t t = d->tiles[i];
+        if (t >= total)
+            return 0;
+
+        const uint32_t x = (t % d->tiles_x) * d->tile;
+        const uint32_t y = (t / d->tiles_x) * d->tile;
+        const uint32_t w = x + d->tile < d->w ? d->tile : d->w - x;
+        const uint32_t h = y + d->tile < d->h ? d->tile : d->h - y;
+
+        for (uint32_t r = 0; r < h; r++) {
+            uint8_t* dst = d->frame + ((size_t) (y + r) * d->w + x) * 4;
+            if (fread(dst, 4, w, d->in) != w)
+                return 0;
+        }
+    }
+
+    return 1;
+}
+
+int main(int argc, char* argv[]) {
+    if (argc != 3) {
+        fprintf(stderr, "usage: vivid_decode <capture> <prefix | ->\n");
+        return 1;
+    }
+
+    decoder d = { .prefix = argv[2] };
+    if (!strcmp(argv[2], "-"))
+        d.out = stdout;
+
+    d.in = fopen(argv[1], "rb");
+    if (!d.in) {
+        fprintf(stderr, "vivid_decode: can't open %s\n", argv[1]);
+        return 1;
+    }
+
+    char magic[8];
+    uint32_t header[4];
+    if (fread(magic, 8, 1, d.in) != 1 || memcmp(magic, DECODE_MAGIC, 8) ||
+            !read_words(d.in, header, 4) || header[0] != DECODE_VERSION ||
+            !header[1] || !header[2] || !header[3]) {
+        fprintf(stderr, "vivid_decode: %s isn't a capture\n", argv[1]);
+        fclose(d.in);
+        return 1;
+    }
+
+    d.w = header[1];
+    d.h = header[2];
+    d.tile = header[3];
+    d.tiles_x = (d.w + d.tile - 1) / d.tile;
+    d.tiles_y = (d.h + d.tile - 1) / d.tile;
+
+    d.frame = (uint8_t*) calloc((size_t) d.w * d.h, 4);
+    d.row = (uint8_t*) malloc((size_t) d.w * 3);
+    d.tiles = (uint32_t*) malloc(sizeof(uint32_t) * d.tiles_x * d.tiles_y);
+    if (!d.frame || !d.row || !d.tiles) {
+        fprintf(stderr, "vivid_decode: out of memory\n");
+        return 1;
+    }
+
+    uint32_t dropped = 0;
+    int status = 0;
+
+    // Each record is the frame number, tile count and time, then the tiles
+    uint32_t record[4];
+    while (read_words(d.in, record, 4)) {
+        if (record[0] < d.emitted) {
+            fprintf(stderr, "vivid_decode: frame %u is out of order\n",
+                record[0]);
+            status = 1;
+            break;
+        }
+
+        // The frame before a gap stands in for the frames dropped in it
+        while (d.emitted < record[0] && !status) {
+            dropped++;
+            status = !emit(&d);
+        }
+
+        if (!status && !read_tiles(&d, record[1])) {
+            fprintf(stderr, "vivid_decode: frame %u is corrupt\n",
+                record[0]);
+            status = 1;
+            break;
+        }
+
+        if (status || !emit(&d)) {
+            fprintf(stderr, "vivid_decode: couldn't write frame %u\n",
+                record[0]);
+            status = 1;
+            break;
+        }
+    }
+
+    fprintf(stderr, "vivid_decode: %ux%u, %u frames (%u dropped)\n",
+        d.w, d.h, d.emitted, dropped);
+
+    fclose(d.in);
+    free(d.frame);
+    free(d.row);
+    free(d.tiles);
+
+    return status;
+}